@@ -0,0 +1,478 @@
+#include <calc/Generator/CodeGen.h>
+#include <calc/Lexer/Lexer.h>
+#include <calc/Parser/FlatAST.h>
+#include <calc/Parser/Parser.h>
+#include <calc/Utils/Diagnostics.h>
+#include <calc/Utils/PhaseTimers.h>
+#include <calc/Utils/SymbolTable.h>
+#include <calc/Utils/WorkloadGenerator.h>
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace calc;
+
+// Command Line Options
+static llvm::cl::opt<unsigned> Statements(
+        "statements",
+        llvm::cl::desc("Number of statements in the generated programs"),
+        llvm::cl::init(20000));
+static llvm::cl::opt<unsigned> Records(
+        "records",
+        llvm::cl::desc("Number of input records for the end-to-end benchmarks"),
+        llvm::cl::init(200000));
+static llvm::cl::opt<char> OptLevel(
+        "O",
+        llvm::cl::desc("Code generation level of the emit benchmark, like the compiler's. [-O0, -O1, -O2, or -O3] (default = '-O0')"),
+        llvm::cl::Prefix,
+        llvm::cl::init('0'));
+static llvm::cl::opt<unsigned> Repetitions(
+        "repetitions",
+        llvm::cl::desc("How often every benchmark runs. The median run is reported."),
+        llvm::cl::init(5));
+static llvm::cl::opt<std::string> Filter(
+        "filter",
+        llvm::cl::desc("Only run the benchmarks whose name contains this text"),
+        llvm::cl::value_desc("text"));
+static llvm::cl::opt<std::string> JSONOutput(
+        "json",
+        llvm::cl::desc("Write the results to this file as JSON"),
+        llvm::cl::value_desc("filename"));
+static llvm::cl::opt<std::string> Baseline(
+        "baseline",
+        llvm::cl::desc("Compare the results with an earlier --json file"),
+        llvm::cl::value_desc("filename"));
+static llvm::cl::opt<double> MaxRegression(
+        "max-regression",
+        llvm::cl::desc("Fail if a benchmark got slower than the baseline by more than this many percent"),
+        llvm::cl::value_desc("percent"),
+        llvm::cl::init(0));
+
+namespace {
+// What a benchmark measured in one run: the seconds that count, and how
+// many items (tokens, nodes, instructions, values) were processed in them
+struct Sample {
+    double Seconds = 0;
+    uint64_t Items = 0;
+};
+
+struct Result {
+    std::string Name;
+    const char *Unit;
+    std::vector<Sample> Samples;
+
+    // Sorted by time, so the median is in the middle
+    const Sample &median() const { return Samples[Samples.size() / 2]; }
+    const Sample &fastest() const { return Samples.front(); }
+    double getItemsPerSecond() const {
+        const Sample &S = median();
+        return S.Seconds > 0 ? S.Items / S.Seconds : 0;
+    }
+};
+
+double secondsSince(std::chrono::steady_clock::time_point Start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+// A generated program, and input for its reads if Records is not 0
+struct Workload {
+    std::string Source;
+    std::string Input;
+    uint64_t NumReads;
+};
+
+Workload generate(uint64_t Statements, uint64_t Variables, uint64_t Records = 0) {
+    WorkloadGenerator::Options Opts;
+    Opts.Statements = Statements;
+    Opts.Variables = Variables;
+    Opts.Depth = 2;
+    Opts.ReadPercent = 0;
+    Opts.PrintPercent = 25;
+    Opts.CompoundPercent = 25;
+    Opts.Seed = 42;
+    WorkloadGenerator Gen(Opts);
+    Workload W;
+    llvm::raw_string_ostream Source(W.Source);
+    Gen.writeProgram(Source);
+    llvm::raw_string_ostream Input(W.Input);
+    Gen.writeInput(Input, Records);
+    W.NumReads = Gen.getNumReads();
+    return W;
+}
+
+// The objects one compile of Source needs, set up the way compileFile does
+struct Frontend {
+    llvm::SourceMgr SrcMgr;
+    std::string Diagnostics;
+    llvm::raw_string_ostream Errs{Diagnostics};
+    DiagnosticsEngine Diags{SrcMgr, Errs};
+    SymbolTable Symbols;
+    std::unique_ptr<Lexer> Lex;
+    std::unique_ptr<Parser> Parse;
+
+    explicit Frontend(llvm::StringRef Source) {
+        SrcMgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBufferCopy(Source, "bench.calc"),
+                llvm::SMLoc());
+        Lex = std::make_unique<Lexer>(SrcMgr, Diags, Symbols);
+        Parse = std::make_unique<Parser>(*Lex);
+    }
+};
+
+uint64_t countInstructions(const llvm::Module &M) {
+    uint64_t Count = 0;
+    for (const llvm::Function &F : M)
+        Count += F.getInstructionCount();
+    return Count;
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine() {
+    std::string Triple = llvm::sys::getDefaultTargetTriple();
+    std::string Error;
+    const llvm::Target *Target = llvm::TargetRegistry::lookupTarget(Triple, Error);
+    if (!Target) {
+        llvm::WithColor::error() << Error << '\n';
+        return nullptr;
+    }
+    llvm::CodeGenOpt::Level Level;
+    switch (OptLevel) {
+        case '1': Level = llvm::CodeGenOpt::Less; break;
+        case '2': Level = llvm::CodeGenOpt::Default; break;
+        case '3': Level = llvm::CodeGenOpt::Aggressive; break;
+        default: Level = llvm::CodeGenOpt::None; break;
+    }
+    return std::unique_ptr<llvm::TargetMachine>(Target->createTargetMachine(
+            Triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_,
+            llvm::CodeModel::Small, Level));
+}
+
+Sample benchLexer(llvm::StringRef Source) {
+    Frontend F(Source);
+    Sample S;
+    auto Start = std::chrono::steady_clock::now();
+    Token Tok;
+    do {
+        F.Lex->next(Tok);
+        ++S.Items;
+    } while (Tok.getKind() != tok::EOI);
+    S.Seconds = secondsSince(Start);
+    return S;
+}
+
+// Includes the lexer, which the parser pulls tokens from
+Sample benchParser(llvm::StringRef Source) {
+    Frontend F(Source);
+    // Parsed the way the LLVM backend parses, with the lookups of sharing
+    F.Parse->setSharing(true);
+    // With whether each one shares nodes with the ones before
+    std::vector<std::pair<AST *, bool>> Trees;
+    Sample S;
+    auto Start = std::chrono::steady_clock::now();
+    while (AST *Tree = F.Parse->parse())
+        Trees.push_back({Tree, F.Parse->sharesWithEarlier()});
+    S.Seconds = secondsSince(Start);
+
+    FlatAST Flat;
+    for (auto [Tree, Shares] : Trees) {
+        if (!Shares) {
+            S.Items += Flat.size();
+            Flat.clear();
+        }
+        Flat.append(Tree);
+    }
+    S.Items += Flat.size();
+    return S;
+}
+
+// Only the time the generator spends building IR, without parsing
+Sample benchIRGen(llvm::StringRef Source, llvm::TargetMachine *TM) {
+    Frontend F(Source);
+    PhaseTimers Timers("bench.calc");
+    CodeGen Gen(*F.Parse);
+    Gen.setTimers(&Timers);
+    Gen.compile("calc-bench", "bench.calc", TM);
+    Sample S;
+    S.Seconds = Timers.get(PhaseTimers::IRGen).getTotalTime().getWallTime();
+    S.Items = countInstructions(*Gen.getModule());
+    Timers.clear();
+    return S;
+}
+
+// Object code for the unoptimized module, like emit() in the driver.
+// The time is negative if the target cannot write object files.
+Sample benchEmit(llvm::StringRef Source, llvm::TargetMachine *TM) {
+    Frontend F(Source);
+    CodeGen Gen(*F.Parse);
+    Gen.compile("calc-bench", "bench.calc", TM);
+    llvm::Module *M = Gen.getModule();
+    Sample S;
+    S.Items = countInstructions(*M);
+
+    llvm::SmallVector<char, 0> Object;
+    llvm::raw_svector_ostream OS(Object);
+    auto Start = std::chrono::steady_clock::now();
+    llvm::legacy::PassManager PM;
+    if (TM->addPassesToEmitFile(PM, OS, nullptr, llvm::CGFT_ObjectFile)) {
+        llvm::WithColor::error() << "No support for object files on "
+            << TM->getTargetTriple().str() << '\n';
+        S.Seconds = -1;
+        return S;
+    }
+    PM.run(*M);
+    S.Seconds = secondsSince(Start);
+    return S;
+}
+
+// Runs Program with its input from InputPath and its output thrown away.
+// Returns the wall time, or a negative number if it failed.
+double runProgram(llvm::StringRef Program, llvm::ArrayRef<llvm::StringRef> Args,
+        std::optional<llvm::StringRef> InputPath) {
+    std::optional<llvm::StringRef> Redirects[] = {InputPath, llvm::StringRef(""),
+        std::nullopt};
+    std::string Error;
+    auto Start = std::chrono::steady_clock::now();
+    int Status = llvm::sys::ExecuteAndWait(Program, Args, std::nullopt, Redirects,
+            0, 0, &Error);
+    double Seconds = secondsSince(Start);
+    if (Status != 0) {
+        llvm::WithColor::error() << Program << " failed"
+            << (Error.empty() ? "" : ": ") << Error << '\n';
+        return -1;
+    }
+    return Seconds;
+}
+
+bool writeFile(llvm::StringRef Path, llvm::StringRef Contents) {
+    std::error_code EC;
+    llvm::raw_fd_ostream Out(Path, EC);
+    if (EC) {
+        llvm::WithColor::error() << "Cannot write " << Path << ": " << EC.message() << '\n';
+        return false;
+    }
+    Out << Contents;
+    return true;
+}
+
+// A generated executable from the calc next to us, run over the input
+struct EndToEnd {
+    std::string Dir;
+    std::string Executable;
+    std::string InputPath;
+    uint64_t Values = 0;
+
+    // Compiles Source with the given options and writes the input
+    bool prepare(llvm::StringRef Name, llvm::StringRef Source, llvm::StringRef Input,
+            uint64_t NumValues, llvm::ArrayRef<llvm::StringRef> Options) {
+        llvm::SmallString<128> Path(Dir);
+        llvm::sys::path::append(Path, Name + ".calc");
+        std::string SourcePath(Path);
+        llvm::sys::path::replace_extension(Path, "");
+        Executable = std::string(Path);
+        llvm::sys::path::replace_extension(Path, "txt");
+        InputPath = std::string(Path);
+        Values = NumValues;
+        if (!writeFile(SourcePath, Source) || !writeFile(InputPath, Input))
+            return false;
+
+        std::vector<llvm::StringRef> Args = {CALC_COMPILER};
+        Args.insert(Args.end(), Options.begin(), Options.end());
+        Args.insert(Args.end(), {"-o", Executable, SourcePath});
+        return runProgram(CALC_COMPILER, Args, std::nullopt) >= 0;
+    }
+
+    Sample run() const {
+        Sample S;
+        S.Seconds = runProgram(Executable, {Executable}, llvm::StringRef(InputPath));
+        S.Items = Values;
+        return S;
+    }
+};
+
+void writeJSON(llvm::raw_ostream &OS, llvm::ArrayRef<Result> Results) {
+    llvm::json::OStream J(OS, /*IndentSize=*/2);
+    J.object([&] {
+        J.attribute("statements", Statements.getValue());
+        J.attribute("records", Records.getValue());
+        J.attribute("opt_level", std::string(1, OptLevel));
+        J.attribute("repetitions", Repetitions.getValue());
+        J.attributeArray("benchmarks", [&] {
+            for (const Result &R : Results)
+                J.object([&] {
+                    J.attribute("name", R.Name);
+                    J.attribute("unit", R.Unit);
+                    J.attribute("items", static_cast<int64_t>(R.median().Items));
+                    J.attribute("median_seconds", R.median().Seconds);
+                    J.attribute("min_seconds", R.fastest().Seconds);
+                    J.attribute("items_per_second", R.getItemsPerSecond());
+                });
+        });
+    });
+    OS << '\n';
+}
+
+// Prints how every benchmark changed since the baseline. Returns false if
+// one of them got slower than --max-regression allows.
+bool compareWithBaseline(llvm::ArrayRef<Result> Results) {
+    auto Buffer = llvm::MemoryBuffer::getFile(Baseline);
+    if (!Buffer) {
+        llvm::WithColor::error() << "Cannot read " << Baseline << ": "
+            << Buffer.getError().message() << '\n';
+        return false;
+    }
+    llvm::Expected<llvm::json::Value> Value = llvm::json::parse((*Buffer)->getBuffer());
+    if (!Value) {
+        llvm::WithColor::error() << "Invalid baseline " << Baseline << ": "
+            << llvm::toString(Value.takeError()) << '\n';
+        return false;
+    }
+    std::map<std::string, double> Before;
+    if (const llvm::json::Object *Root = Value->getAsObject())
+        if (const llvm::json::Array *Benchmarks = Root->getArray("benchmarks"))
+            for (const llvm::json::Value &B : *Benchmarks)
+                if (const llvm::json::Object *O = B.getAsObject())
+                    if (auto Name = O->getString("name"))
+                        if (auto Seconds = O->getNumber("median_seconds"))
+                            Before[Name->str()] = *Seconds;
+
+    bool Passed = true;
+    llvm::outs() << "\nCompared with " << Baseline << ":\n";
+    for (const Result &R : Results) {
+        auto It = Before.find(R.Name);
+        if (It == Before.end() || It->second <= 0) {
+            llvm::outs() << llvm::formatv("  {0,-16} new\n", R.Name);
+            continue;
+        }
+        double Change = (R.median().Seconds / It->second - 1) * 100;
+        bool Regressed = MaxRegression > 0 && Change > MaxRegression;
+        llvm::outs() << llvm::formatv("  {0,-16} {1,+7:F1}%{2}\n", R.Name, Change,
+                Regressed ? "  REGRESSION" : "");
+        Passed &= !Regressed;
+    }
+    return Passed;
+}
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "Calc benchmarks\n");
+    if (OptLevel < '0' || OptLevel > '3') {
+        llvm::WithColor::error(llvm::errs(), argv_[0])
+            << "Invalid optimization level: -O" << OptLevel << '\n';
+        return 1;
+    }
+    if (Repetitions == 0)
+        Repetitions = 1;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+    std::unique_ptr<llvm::TargetMachine> TM = createTargetMachine();
+    if (!TM)
+        return 1;
+
+    llvm::SmallString<128> Dir;
+    if (std::error_code EC = llvm::sys::fs::createUniqueDirectory("calc-bench", Dir)) {
+        llvm::WithColor::error() << "Cannot create a directory: " << EC.message() << '\n';
+        return 1;
+    }
+
+    // The compiler benchmarks share one big program. The end-to-end ones
+    // run small programs over many records: one prints a value for every
+    // statement of every run, the other is compiled with --batch.
+    const uint64_t NumVars = 256;
+    const uint64_t PrintStatements = NumVars + Records / 256;
+    std::string Source = generate(std::max<uint64_t>(Statements, NumVars), NumVars).Source;
+    Workload Print1 = generate(PrintStatements, NumVars, 1);
+    Workload Kernel = generate(48, 16, Records);
+
+    EndToEnd Print, Batch;
+    Print.Dir = Batch.Dir = std::string(Dir);
+
+    struct Benchmark {
+        const char *Name;
+        const char *Unit;
+        std::function<bool()> Prepare;
+        std::function<Sample()> Run;
+    };
+    std::vector<Benchmark> Benchmarks = {
+        {"lexer", "tokens", nullptr, [&] { return benchLexer(Source); }},
+        {"parser", "nodes", nullptr, [&] { return benchParser(Source); }},
+        {"irgen", "instructions", nullptr, [&] { return benchIRGen(Source, TM.get()); }},
+        {"emit", "instructions", nullptr, [&] { return benchEmit(Source, TM.get()); }},
+        // Every statement of a program that runs once prints a value
+        {"e2e.print", "values",
+            [&] { return Print.prepare("print", Print1.Source, Print1.Input,
+                    PrintStatements, {"-O2"}); },
+            [&] { return Print.run(); }},
+        {"e2e.batch", "values",
+            [&] { return Batch.prepare("batch", Kernel.Source, Kernel.Input,
+                    Kernel.NumReads * Records, {"-O2", "--batch"}); },
+            [&] { return Batch.run(); }},
+    };
+
+    std::vector<Result> Results;
+    bool Failed = false;
+    llvm::outs() << llvm::formatv("{0,-16} {1,12} {2,12} {3,16}\n",
+            "benchmark", "median (s)", "min (s)", "items/s");
+    for (const Benchmark &B : Benchmarks) {
+        if (!llvm::StringRef(B.Name).contains(Filter))
+            continue;
+        if (B.Prepare && !B.Prepare()) {
+            Failed = true;
+            continue;
+        }
+        Result R{B.Name, B.Unit, {}};
+        for (unsigned I = 0; I < Repetitions; ++I)
+            R.Samples.push_back(B.Run());
+        if (llvm::any_of(R.Samples, [](const Sample &S) { return S.Seconds < 0; })) {
+            Failed = true;
+            continue;
+        }
+        llvm::sort(R.Samples, [](const Sample &A, const Sample &B) {
+            return A.Seconds < B.Seconds;
+        });
+        llvm::outs() << llvm::formatv("{0,-16} {1,12:F6} {2,12:F6} {3,16:E3} {4}\n",
+                R.Name, R.median().Seconds, R.fastest().Seconds,
+                R.getItemsPerSecond(), R.Unit);
+        Results.push_back(std::move(R));
+    }
+    llvm::sys::fs::remove_directories(Dir);
+
+    if (!JSONOutput.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream Out(JSONOutput, EC);
+        if (EC) {
+            llvm::WithColor::error() << "Cannot write " << JSONOutput << ": "
+                << EC.message() << '\n';
+            return 1;
+        }
+        writeJSON(Out, Results);
+    }
+    if (!Baseline.empty() && !compareWithBaseline(Results))
+        Failed = true;
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+#include <calc/Utils/WorkloadGenerator.h>
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+using namespace calc;
+
+// Command Line Options
+static llvm::cl::opt<uint64_t> Statements(
+        "statements",
+        llvm::cl::desc("Number of statements, including the one defining each variable"),
+        llvm::cl::init(1000));
+static llvm::cl::opt<uint64_t> Variables(
+        "variables",
+        llvm::cl::desc("Number of distinct variables"),
+        llvm::cl::init(100));
+static llvm::cl::opt<unsigned> Depth(
+        "depth",
+        llvm::cl::desc("Number of operators between the root of every expression and its deepest operand"),
+        llvm::cl::init(3));
+static llvm::cl::opt<unsigned> LeadingReads(
+        "leading-reads",
+        llvm::cl::desc("Number of variables read from the input before the others are computed from them"),
+        llvm::cl::init(8));
+static llvm::cl::opt<unsigned> ReadPercent(
+        "reads",
+        llvm::cl::desc("Percentage of the later statements that are reads"),
+        llvm::cl::value_desc("percent"),
+        llvm::cl::init(5));
+static llvm::cl::opt<unsigned> PrintPercent(
+        "prints",
+        llvm::cl::desc("Percentage of the later statements that only print an expression"),
+        llvm::cl::value_desc("percent"),
+        llvm::cl::init(30));
+static llvm::cl::opt<unsigned> CompoundPercent(
+        "compound",
+        llvm::cl::desc("Percentage of the assignments that use += or -="),
+        llvm::cl::value_desc("percent"),
+        llvm::cl::init(30));
+static llvm::cl::opt<uint64_t> Seed(
+        "seed",
+        llvm::cl::desc("Seed of the random choices. The same seed gives the same program."),
+        llvm::cl::init(1));
+static llvm::cl::opt<std::string> OutputFilename(
+        "o", llvm::cl::desc("Output filename"),
+        llvm::cl::value_desc("filename"),
+        llvm::cl::init("-"));
+static llvm::cl::opt<std::string> InputFilename(
+        "input-file",
+        llvm::cl::desc("Also write input for the reads of the program to this file"),
+        llvm::cl::value_desc("filename"));
+static llvm::cl::opt<uint64_t> Records(
+        "records",
+        llvm::cl::desc("Number of times the input file holds a value for every read"),
+        llvm::cl::init(1));
+
+// Opens Path for writing, or reports why it cannot
+static std::unique_ptr<llvm::raw_fd_ostream> openOutput(const char *Argv0, llvm::StringRef Path) {
+    std::error_code EC;
+    auto Out = std::make_unique<llvm::raw_fd_ostream>(Path, EC);
+    if (EC) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot write " << Path << ": " << EC.message() << '\n';
+        return nullptr;
+    }
+    return Out;
+}
+
+// Closes Out, which was opened for Path, and reports if anything written
+// to it was lost
+static bool closeOutput(const char *Argv0, llvm::raw_fd_ostream &Out, llvm::StringRef Path) {
+    Out.close();
+    if (Out.has_error()) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot write " << Path << ": " << Out.error().message() << '\n';
+        Out.clear_error();
+        return false;
+    }
+    return true;
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "Calc workload generator\n");
+
+    WorkloadGenerator::Options Opts;
+    Opts.Statements = Statements;
+    Opts.Variables = Variables;
+    Opts.Depth = Depth;
+    Opts.LeadingReads = LeadingReads;
+    Opts.ReadPercent = ReadPercent;
+    Opts.PrintPercent = PrintPercent;
+    Opts.CompoundPercent = CompoundPercent;
+    Opts.Seed = Seed;
+    std::string Error;
+    if (!WorkloadGenerator::validate(Opts, Error)) {
+        llvm::WithColor::error(llvm::errs(), argv_[0]) << "Invalid options: " << Error << '\n';
+        return 1;
+    }
+
+    std::unique_ptr<llvm::raw_fd_ostream> Out = openOutput(argv_[0], OutputFilename);
+    if (!Out)
+        return 1;
+    WorkloadGenerator Gen(Opts);
+    Gen.writeProgram(*Out);
+    if (!closeOutput(argv_[0], *Out, OutputFilename))
+        return 1;
+
+    if (!InputFilename.empty()) {
+        std::unique_ptr<llvm::raw_fd_ostream> In = openOutput(argv_[0], InputFilename);
+        if (!In)
+            return 1;
+        Gen.writeInput(*In, Records);
+        if (!closeOutput(argv_[0], *In, InputFilename))
+            return 1;
+    }
+    return 0;
+}
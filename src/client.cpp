@@ -0,0 +1,31 @@
+#include <calc/Server/Server.h>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// A client of calc --server. Starting it costs little more than starting
+// any small program, since it never sets up LLVM. Everything but --connect
+// is passed on, so it takes the same arguments as calc itself.
+int main(int argc_, const char **argv_) {
+    std::string Socket;
+    if (const char *FromEnv = std::getenv("CALC_SERVER"))
+        Socket = FromEnv;
+
+    std::vector<const char *> Args = {"calc"};
+    for (int i = 1; i < argc_; ++i) {
+        llvm::StringRef Arg = argv_[i];
+        if (Arg.consume_front("--connect=") || Arg.consume_front("-connect="))
+            Socket = Arg.str();
+        else
+            Args.push_back(argv_[i]);
+    }
+    if (Socket.empty()) {
+        llvm::WithColor::error(llvm::errs(), argv_[0])
+            << "No server, use --connect=<socket> or set CALC_SERVER\n";
+        return 1;
+    }
+    return calc::runClient(argv_[0], Socket, Args);
+}
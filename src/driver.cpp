@@ -1,6 +1,17 @@
+#include <calc/Utils/CompileCache.h>
 #include <calc/Utils/Diagnostics.h>
+#include <calc/Utils/PhaseTimers.h>
+#include <calc/Server/Server.h>
 #include <calc/Generator/CodeGen.h>
+#include <calc/Generator/Interpreter.h>
+#include <calc/VM/Bytecode.h>
+#include <calc/VM/VM.h>
+#include <calc/Runtime/Runtime.h>
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/ToolOutputFile.h"
@@ -11,18 +22,39 @@
 
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/VersionTuple.h"
 #include "llvm/TargetParser/Host.h"
 
 #include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/Pass.h"
+#include "llvm/Passes/PassBuilder.h"
+#ifdef CALC_HAVE_LLD
+#include "lld/Common/Driver.h"
+LLD_HAS_DRIVER(elf)
+#endif
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 using namespace calc;
 
+static constexpr const char CalcVersion[] = "1.0.0";
+
 // Command Line Options
 static llvm::cl::opt<std::string> MTriple("mtriple", llvm::cl::desc("Override target triple for module"));
 static llvm::cl::opt<bool> EmitLLVM(
@@ -37,16 +69,189 @@ static llvm::cl::opt<bool> EmitObj(
         "c",
         llvm::cl::desc("Emit Object code (.o)"),
         llvm::cl::init(false));
+static llvm::cl::opt<bool> RunJIT(
+        "run",
+        llvm::cl::desc("Run the program in-process with the JIT instead of linking an executable"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> Repl(
+        "repl",
+        llvm::cl::desc("Read statements from standard input and run each one with the JIT as soon as it is complete"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> Batch(
+        "batch",
+        llvm::cl::desc("Compile the program into a loop that runs it once for every record of input values"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> Freestanding(
+        "freestanding",
+        llvm::cl::desc("Link a static executable that starts itself and makes its own system calls, without the C library"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> Bigint(
+        "bigint",
+        llvm::cl::desc("Compute with integers of any size instead of wrapping around at 64 bits"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> Interpret(
+        "interpret",
+        llvm::cl::desc("Evaluate the program directly without LLVM code generation"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> RunVM(
+        "vm",
+        llvm::cl::desc("Lower the program to register bytecode and run it on the VM"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> DumpBytecode(
+        "dump-bytecode",
+        llvm::cl::desc("Print the register bytecode of the program instead of running it"),
+        llvm::cl::init(false));
+static llvm::cl::opt<char> OptLevel(
+        "O",
+        llvm::cl::desc("Optimization level. [-O0, -O1, -O2, or -O3] (default = '-O0')"),
+        llvm::cl::Prefix,
+        llvm::cl::init('0'));
 static llvm::cl::list<std::string> InputFiles(
         llvm::cl::Positional,
         llvm::cl::desc("<input files>"),
-        llvm::cl::OneOrMore);
+        llvm::cl::ZeroOrMore);
+static llvm::cl::opt<std::string> InputPath(
+        "input",
+        llvm::cl::desc("Read the values of read statements from this file instead of standard input when the compiler runs the program"),
+        llvm::cl::value_desc("path"));
+static llvm::cl::list<std::string> Bindings(
+        "bind",
+        llvm::cl::desc("Specialize the compiled program for input known ahead of time: every read of name produces value"),
+        llvm::cl::value_desc("name=value"));
 static llvm::cl::opt<std::string> OutputFilename(
         "o", llvm::cl::desc("Output filename"),
         llvm::cl::value_desc("filename"));
-static llvm::CodeGenFileType FileType;
+enum LinkerKind { LLDLinker, SystemLinker };
+static llvm::cl::opt<LinkerKind> Linker(
+        "linker",
+        llvm::cl::desc("How to link executables"),
+        llvm::cl::values(
+            clEnumValN(LLDLinker, "lld", "Link in-process with LLD"),
+            clEnumValN(SystemLinker, "gcc", "Run gcc")),
+        llvm::cl::init(SystemLinker));
+static llvm::cl::opt<std::string> CacheDir(
+        "cache-dir",
+        llvm::cl::desc("Reuse the outputs of earlier compiles kept in this directory (default: $CALC_CACHE_DIR)"),
+        llvm::cl::value_desc("path"));
+static llvm::cl::opt<std::string> CachePolicy(
+        "cache-policy",
+        llvm::cl::desc("When to evict cache entries, e.g. prune_after=168h:cache_size_bytes=1g"),
+        llvm::cl::value_desc("policy"),
+        llvm::cl::init("cache_size_bytes=1g"));
+static llvm::cl::opt<bool> CacheStats(
+        "cache-stats",
+        llvm::cl::desc("Print how many outputs were taken from the cache"),
+        llvm::cl::init(false));
+static llvm::cl::opt<bool> TimeReport(
+        "time-report",
+        llvm::cl::desc("Print how long each phase of compiling every file took"),
+        llvm::cl::init(false));
+static llvm::cl::opt<std::string> TimeReportJSON(
+        "time-report-json",
+        llvm::cl::desc("Write how long each phase of compiling every file took to this file as JSON"),
+        llvm::cl::value_desc("filename"));
+static llvm::cl::opt<unsigned> Jobs(
+        "j",
+        llvm::cl::desc("Number of input files to compile in parallel"),
+        llvm::cl::value_desc("N"),
+        llvm::cl::Prefix,
+        llvm::cl::init(1));
+static llvm::cl::opt<std::string> ServerSocket(
+        "server",
+        llvm::cl::desc("Keep running and compile for the clients that connect to this Unix domain socket"),
+        llvm::cl::value_desc("socket"));
+
+// Bindings parsed from --bind
+static std::vector<std::pair<std::string, int64_t>> BoundInputs;
+
+// Splits every --bind into its name and value
+bool parseBindings(const char *Argv0) {
+    for (const std::string &B : Bindings) {
+        auto [Name, ValueStr] = llvm::StringRef(B).split('=');
+        int64_t Value;
+        bool ValidName = !Name.empty() && !llvm::isDigit(Name.front()) &&
+            llvm::all_of(Name, [](char C) { return llvm::isAlnum(C) || C == '_'; });
+        if (!ValidName || ValueStr.getAsInteger(10, Value)) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "Invalid binding '" << B << "', expected name=value\n";
+            return false;
+        }
+        BoundInputs.emplace_back(Name.str(), Value);
+    }
+    return true;
+}
+
+// Set when compiled outputs are cached
+static std::unique_ptr<CompileCache> Cache;
+static std::string CompilerID;
+
+// Identifies this build of the compiler, so a rebuilt compiler never
+// reuses what an older one produced
+std::string getCompilerID(const char *Argv0) {
+    std::string ID = std::string("Calc ") + CalcVersion;
+    std::string Exe = llvm::sys::fs::getMainExecutable(
+            Argv0, reinterpret_cast<void *>(&getCompilerID));
+    llvm::sys::fs::file_status Status;
+    if (!llvm::sys::fs::status(Exe, Status)) {
+        ID += ' ' + std::to_string(Status.getSize());
+        ID += ' ' + std::to_string(Status.getLastModificationTime().time_since_epoch().count());
+    }
+    return ID;
+}
+
+// Hashes everything that can change what compileFile writes for the file
+// Path with the contents Source. The module is named after Path, and every
+// kind of output carries that name.
+std::string getCacheKey(llvm::StringRef Path, llvm::StringRef Source,
+        llvm::StringRef OutputKind) {
+    std::optional<llvm::Reloc::Model> RelocModel = llvm::codegen::getRelocModel();
+    std::vector<std::string> Parts = {
+        CompilerID,
+        !MTriple.empty() ? llvm::Triple::normalize(MTriple) : llvm::sys::getDefaultTargetTriple(),
+        llvm::codegen::getMArch(),
+        llvm::codegen::getCPUStr(),
+        llvm::codegen::getFeaturesStr(),
+        std::to_string(RelocModel ? static_cast<int>(*RelocModel) : -1),
+        std::string(1, OptLevel),
+        OutputKind.str(),
+        Batch ? "batch" : "",
+        Bigint ? "bigint" : "",
+        Freestanding ? "freestanding" : "",
+        Linker == LLDLinker ? "lld" : "gcc",
+        std::to_string(BoundInputs.size()),
+    };
+    for (const auto &[Name, Value] : BoundInputs)
+        Parts.push_back(Name + '=' + std::to_string(Value));
+    Parts.push_back(Path.str());
+    Parts.push_back(Source.str());
+    llvm::SmallVector<llvm::StringRef, 16> Refs(Parts.begin(), Parts.end());
+    return CompileCache::computeKey(Refs);
+}
 
-llvm::TargetMachine* createTargetMachine(const char* Argv0) {
+// The interpreter and the VM never generate machine code
+bool usesLLVMBackend() {
+    return Repl || (!Interpret && !RunVM && !DumpBytecode);
+}
+
+llvm::OptimizationLevel getOptLevel() {
+    switch (OptLevel) {
+        case '1': return llvm::OptimizationLevel::O1;
+        case '2': return llvm::OptimizationLevel::O2;
+        case '3': return llvm::OptimizationLevel::O3;
+        default: return llvm::OptimizationLevel::O0;
+    }
+}
+
+llvm::CodeGenOpt::Level getCodeGenOptLevel() {
+    switch (OptLevel) {
+        case '1': return llvm::CodeGenOpt::Less;
+        case '2': return llvm::CodeGenOpt::Default;
+        case '3': return llvm::CodeGenOpt::Aggressive;
+        default: return llvm::CodeGenOpt::None;
+    }
+}
+
+llvm::TargetMachine* createTargetMachine(const char* Argv0, llvm::raw_ostream &Errs) {
     llvm::Triple Triple = llvm::Triple(
             !MTriple.empty()
                 ? llvm::Triple::normalize(MTriple)
@@ -64,52 +269,73 @@ llvm::TargetMachine* createTargetMachine(const char* Argv0) {
         llvm::TargetRegistry::lookupTarget(
                 llvm::codegen::getMArch(), Triple, Error);
     if (!Target) {
-        llvm::WithColor::error(llvm::errs(), Argv0) << Error;
+        llvm::WithColor::error(Errs, Argv0) << Error;
         return nullptr;
     }
 
+    // Freestanding executables are never loaded anywhere but their own
+    // address, so they need no position independent code
     std::optional<llvm::Reloc::Model> RelocModel = llvm::codegen::getRelocModel();
     if (!RelocModel) 
-        RelocModel = llvm::Reloc::PIC_;
+        RelocModel = Freestanding ? llvm::Reloc::Static : llvm::Reloc::PIC_;
     llvm::TargetMachine* TM = Target->createTargetMachine(
             Triple.getTriple(), CPUStr, FeatureStr,
             TargetOptions, RelocModel,
-            llvm::CodeModel::Small);
+            llvm::CodeModel::Small, getCodeGenOptLevel());
     return TM;
 }
 
-bool emit(llvm::StringRef Argv0, llvm::Module *M, 
-        llvm::TargetMachine *TM, llvm::StringRef InputFilename) {
-    if (OutputFilename.empty()) {
-        if (InputFilename == "-")
-            OutputFilename = "-";
-        else {
-            if (InputFilename.endswith(".calc"))
-                OutputFilename = InputFilename.drop_back(5).str();
-            else {
-                llvm::WithColor::error(llvm::errs(), Argv0) 
-                    << "File Extension not supported\n";
-                return false;
-            }
-            switch (FileType) {
-                case llvm::CGFT_AssemblyFile:
-                    OutputFilename.append(EmitLLVM ? ".ll" : ".s");
-                    break;
-                case llvm::CGFT_ObjectFile:
-                    OutputFilename.append(".o");
-                    break;
-                case llvm::CGFT_Null:
-                    OutputFilename.append(".null");
-                    break;
-            }
-        }
+void optimize(llvm::Module *M, llvm::TargetMachine *TM) {
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+
+    llvm::PassBuilder PB(TM);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    llvm::OptimizationLevel Level = getOptLevel();
+    llvm::ModulePassManager MPM = Level == llvm::OptimizationLevel::O0
+        ? PB.buildO0DefaultPipeline(Level)
+        : PB.buildPerModuleDefaultPipeline(Level);
+    MPM.run(*M, MAM);
+}
+
+std::string getOutputFilename(llvm::StringRef InputFilename, llvm::CodeGenFileType FileType) {
+    if (InputFilename == "-")
+        return "-";
+    std::string Name = InputFilename.drop_back(5).str();
+    switch (FileType) {
+        case llvm::CGFT_AssemblyFile:
+            Name.append(EmitLLVM ? ".ll" : ".s");
+            break;
+        case llvm::CGFT_ObjectFile:
+            Name.append(".o");
+            break;
+        case llvm::CGFT_Null:
+            Name.append(".null");
+            break;
     }
+    return Name;
+}
+
+bool emit(llvm::StringRef Argv0, llvm::Module *M, llvm::TargetMachine *TM,
+        llvm::StringRef OutputFile, llvm::CodeGenFileType FileType,
+        llvm::raw_ostream &Errs) {
     std::error_code EC;
+    // Replace the file instead of writing into it. It may be a hard link
+    // to a cache entry, which must keep its contents.
+    if (OutputFile != "-")
+        llvm::sys::fs::remove(OutputFile);
     llvm::sys::fs::OpenFlags OpenFlags = static_cast<llvm::sys::fs::OpenFlags>(0);
     auto Out = std::make_unique<llvm::ToolOutputFile>(
-            OutputFilename, EC, OpenFlags);
+            OutputFile, EC, OpenFlags);
     if (EC) {
-        llvm::WithColor::error(llvm::errs(), Argv0) << EC.message() << '\n';
+        llvm::WithColor::error(Errs, Argv0) << EC.message() << '\n';
         return false;
     }
     llvm::legacy::PassManager PM;
@@ -117,7 +343,7 @@ bool emit(llvm::StringRef Argv0, llvm::Module *M,
         PM.add(createPrintModulePass(Out->os()));
     else
         if (TM->addPassesToEmitFile(PM, Out->os(), nullptr, FileType)) {
-            llvm::WithColor::error(llvm::errs(), Argv0) << "No support for file type\n";
+            llvm::WithColor::error(Errs, Argv0) << "No support for file type\n";
             return false;
         }
     PM.run(*M);
@@ -125,16 +351,138 @@ bool emit(llvm::StringRef Argv0, llvm::Module *M,
     return true;
 }
 
-bool linkExecutable(llvm::StringRef Argv0, llvm::StringRef ObjectFile, llvm::StringRef OutputFile) {
+// Where the C library of a target keeps its startup files, where gcc keeps
+// crtbegin.o, crtend.o and libgcc, and the dynamic loader programs ask for
+struct LibcLayout {
+    std::string Dir;
+    std::string GccDir;
+    const char *Loader;
+};
+
+// gcc has a directory of its own for every target and version, like
+// /usr/lib/gcc/x86_64-linux-gnu/12. Picks the newest one for the
+// architecture of Triple, which is the one a plain gcc would use.
+std::optional<std::string> findGccLib(const llvm::Triple &Triple) {
+    std::optional<std::string> Found;
+    llvm::VersionTuple FoundVersion;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator Target("/usr/lib/gcc", EC), End;
+            !EC && Target != End; Target.increment(EC)) {
+        if (llvm::Triple(llvm::sys::path::filename(Target->path())).getArch() != Triple.getArch())
+            continue;
+        std::error_code VersionEC;
+        for (llvm::sys::fs::directory_iterator Version(Target->path(), VersionEC);
+                !VersionEC && Version != End; Version.increment(VersionEC)) {
+            llvm::VersionTuple V;
+            // tryParse returns true if the name is not a version
+            if (V.tryParse(llvm::sys::path::filename(Version->path())))
+                continue;
+            if ((!Found || V > FoundVersion)
+                    && llvm::sys::fs::exists(Version->path() + "/crtbegin.o")) {
+                Found = Version->path();
+                FoundVersion = V;
+            }
+        }
+    }
+    return Found;
+}
+
+// Only knows the usual glibc layouts next to an installed gcc. Anything
+// else is left to gcc, which knows where its own C library lives.
+std::optional<LibcLayout> findLibc(const llvm::Triple &Triple) {
+    if (!Triple.isOSLinux() || Triple.isMusl())
+        return std::nullopt;
+    const char *Loader;
+    switch (Triple.getArch()) {
+        case llvm::Triple::x86_64: Loader = "/lib64/ld-linux-x86-64.so.2"; break;
+        case llvm::Triple::aarch64: Loader = "/lib/ld-linux-aarch64.so.1"; break;
+        default: return std::nullopt;
+    }
+    std::optional<std::string> GccDir = findGccLib(Triple);
+    if (!GccDir)
+        return std::nullopt;
+    std::string Multiarch = (Triple.getArchName() + "-linux-gnu").str();
+    for (std::string Dir : {"/usr/lib/" + Multiarch, "/lib/" + Multiarch,
+                std::string("/usr/lib64"), std::string("/usr/lib")})
+        if (llvm::sys::fs::exists(Dir + "/crt1.o"))
+            return LibcLayout{Dir, *GccDir, Loader};
+    return std::nullopt;
+}
+
+#ifdef CALC_HAVE_LLD
+// Links the way gcc -no-pie would, without starting any process.
+// Returns std::nullopt if LLD cannot be used, and the result otherwise.
+std::optional<bool> linkWithLLD(llvm::StringRef Argv0, llvm::StringRef ObjectFile,
+        llvm::StringRef OutputFile, const llvm::Triple &Triple, llvm::raw_ostream &Errs) {
+    std::string Object = ObjectFile.str();
+    std::string Output = OutputFile.str();
+    std::vector<const char *> Args;
+    std::string Crt1, Crti, CrtBegin, CrtEnd, Crtn;
+    std::optional<LibcLayout> Libc;
+    if (Freestanding) {
+        // The module brings its own _start, and the runtime its own system
+        // calls, so there is nothing else to link
+        Args = {"ld.lld", "-static", "-o", Output.c_str(), Object.c_str(),
+            CALC_FREESTANDING_RUNTIME_LIBRARY};
+    } else {
+        Libc = findLibc(Triple);
+        if (!Libc)
+            return std::nullopt;
+        Crt1 = Libc->Dir + "/crt1.o";
+        Crti = Libc->Dir + "/crti.o";
+        Crtn = Libc->Dir + "/crtn.o";
+        CrtBegin = Libc->GccDir + "/crtbegin.o";
+        CrtEnd = Libc->GccDir + "/crtend.o";
+        // libgcc goes on both sides of the C library, and libgcc_s is only
+        // kept if something needs it, as gcc does
+        Args = {"ld.lld", "--no-pie", "--eh-frame-hdr", "--dynamic-linker", Libc->Loader,
+            "-o", Output.c_str(), Crt1.c_str(), Crti.c_str(), CrtBegin.c_str(),
+            "-L", Libc->GccDir.c_str(), "-L", Libc->Dir.c_str(),
+            Object.c_str(), CALC_RUNTIME_LIBRARY,
+            "-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state", "-lc",
+            "-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state",
+            CrtEnd.c_str(), Crtn.c_str()};
+    }
+
+    // LLD keeps its state in globals, so links never run side by side.
+    // After a crash that state is lost, and gcc takes over.
+    static std::mutex LLDLock;
+    static bool CanRunAgain = true;
+    std::lock_guard<std::mutex> Guard(LLDLock);
+    if (!CanRunAgain)
+        return std::nullopt;
+    lld::Result Result = lld::lldMain(Args, Errs, Errs, {{lld::Gnu, &lld::elf::link}});
+    CanRunAgain = Result.canRunAgain;
+    if (Result.retCode != 0) {
+        llvm::WithColor::error(Errs, Argv0) << "Linking " << OutputFile << " failed\n";
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool linkExecutable(llvm::StringRef Argv0, llvm::StringRef ObjectFile,
+        llvm::StringRef OutputFile, const llvm::Triple &Triple, llvm::raw_ostream &Errs) {
+    // Like emit, never write into a hard link to a cache entry
+    llvm::sys::fs::remove(OutputFile);
+#ifdef CALC_HAVE_LLD
+    if (Linker == LLDLinker)
+        if (std::optional<bool> Linked = linkWithLLD(Argv0, ObjectFile, OutputFile, Triple, Errs))
+            return *Linked;
+#endif
+
     // Use system linker (gcc or clang)
-    std::string LinkerCmd = "gcc -no-pie ";
+    std::string LinkerCmd = Freestanding ? "gcc -static -nostdlib -no-pie " : "gcc -no-pie ";
     LinkerCmd += ObjectFile.str();
+    // The program prints its results through the runtime library
+    LinkerCmd += " ";
+    LinkerCmd += Freestanding ? CALC_FREESTANDING_RUNTIME_LIBRARY : CALC_RUNTIME_LIBRARY;
     LinkerCmd += " -o ";
     LinkerCmd += OutputFile.str();
     
     int result = system(LinkerCmd.c_str());
     if (result != 0) {
-        llvm::WithColor::error(llvm::errs(), Argv0) 
+        llvm::WithColor::error(Errs, Argv0) 
             << "Linking failed with code " << result << '\n';
         return false;
     }
@@ -145,11 +493,390 @@ bool linkExecutable(llvm::StringRef Argv0, llvm::StringRef ObjectFile, llvm::Str
     return true;
 }
 
-int main(int argc_, const char **argv_) {
-    llvm::InitLLVM X(argc_, argv_);
-    static llvm::codegen::RegisterCodeGenFlags CGF;
-    llvm::outs() << "Calc " << "Version 1.0.0" << '\n';
+// Prints the tables of -time-report and writes the file of
+// -time-report-json, one entry per input file in command line order
+bool reportTimes(llvm::StringRef Argv0,
+        llvm::ArrayRef<std::unique_ptr<PhaseTimers>> Timers) {
+    // With -j the user and system times of a file include the other files
+    // compiled at the same time, so only the wall time is reported
+    bool CPUTimes = Jobs <= 1 || RunJIT;
+    bool Written = true;
+    if (!TimeReportJSON.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream Out(TimeReportJSON, EC);
+        if (EC) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "Cannot write " << TimeReportJSON << ": " << EC.message() << '\n';
+            Written = false;
+        } else {
+            llvm::json::OStream J(Out, /*IndentSize=*/2);
+            J.object([&] {
+                J.attribute("version", CalcVersion);
+                J.attributeArray("files", [&] {
+                    for (const auto &T : Timers)
+                        T->writeJSON(J, CPUTimes);
+                });
+            });
+            Out << '\n';
+        }
+    }
+    for (const auto &T : Timers) {
+        if (TimeReport)
+            T->print(llvm::errs(), CPUTimes);
+        T->clear();
+    }
+    return Written;
+}
+
+// Read and BigRead are the functions that read statements call, without
+// and with --bigint.
+std::unique_ptr<llvm::orc::LLJIT> createJIT(llvm::StringRef Argv0, llvm::raw_ostream &Errs,
+        void (*Read)(int64_t *) = calc_read, void (*BigRead)(int64_t *) = calc_read_big) {
+    auto JTMB = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!JTMB) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(JTMB.takeError()) << '\n';
+        return nullptr;
+    }
+    JTMB->setCodeGenOptLevel(getCodeGenOptLevel());
+
+    auto JIT = llvm::orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(std::move(*JTMB))
+        .create();
+    if (!JIT) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(JIT.takeError()) << '\n';
+        return nullptr;
+    }
+
+    // Anything else the code calls is resolved against the symbols of this process
+    auto ProcessSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            (*JIT)->getDataLayout().getGlobalPrefix());
+    if (!ProcessSymbols) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(ProcessSymbols.takeError()) << '\n';
+        return nullptr;
+    }
+    (*JIT)->getMainJITDylib().addGenerator(std::move(*ProcessSymbols));
+
+    // The runtime library is linked into the compiler itself, so the JIT
+    // uses our own copy of it
+    llvm::orc::MangleAndInterner Mangle((*JIT)->getExecutionSession(), (*JIT)->getDataLayout());
+    llvm::orc::SymbolMap Runtime;
+    Runtime[Mangle("calc_print")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_print),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_write")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_write),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_flush")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_flush),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_read")] = {llvm::orc::ExecutorAddr::fromPtr(Read),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_read_columns")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_read_columns),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_print_columns")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_print_columns),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_init")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_init),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_print_big")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_print_big),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_read_big")] = {llvm::orc::ExecutorAddr::fromPtr(BigRead),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_big_add")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_big_add),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_big_sub")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_big_sub),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_big_mul")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_big_mul),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_big_from_int")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_big_from_int),
+        llvm::JITSymbolFlags::Exported};
+    Runtime[Mangle("calc_big_from_digits")] = {llvm::orc::ExecutorAddr::fromPtr(&calc_big_from_digits),
+        llvm::JITSymbolFlags::Exported};
+    if (llvm::Error Err = (*JIT)->getMainJITDylib().define(
+                llvm::orc::absoluteSymbols(std::move(Runtime)))) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(std::move(Err)) << '\n';
+        return nullptr;
+    }
+    return std::move(*JIT);
+}
+
+bool runJIT(llvm::StringRef Argv0, llvm::orc::ThreadSafeModule TSM,
+        int &ExitCode, llvm::raw_ostream &Errs) {
+    std::unique_ptr<llvm::orc::LLJIT> JIT = createJIT(Argv0, Errs);
+    if (!JIT)
+        return false;
+
+    if (llvm::Error Err = JIT->addIRModule(std::move(TSM))) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(std::move(Err)) << '\n';
+        return false;
+    }
+
+    auto MainSym = JIT->lookup("main");
+    if (!MainSym) {
+        llvm::WithColor::error(Errs, Argv0) << llvm::toString(MainSym.takeError()) << '\n';
+        return false;
+    }
+    auto *Main = MainSym->toPtr<int (*)(int, char **)>();
+
+    // Our own output must come out before anything the program prints
+    llvm::outs().flush();
+    ExitCode = Main(0, nullptr);
+    std::fflush(stdout);
+    return true;
+}
+
+// Appends one line of standard input to Line, newline included.
+// Returns false once standard input is exhausted.
+bool readLine(std::string &Line) {
+    char Chunk[256];
+    bool ReadAny = false;
+    while (std::fgets(Chunk, sizeof(Chunk), stdin)) {
+        ReadAny = true;
+        Line += Chunk;
+        if (Line.back() == '\n')
+            return true;
+    }
+    return ReadAny;
+}
+
+// The REPL reads its statements through stdio, so the values of read
+// statements typed in between must come from the same stdio buffer.
+void readFromREPLInput(int64_t *Slot) {
+    std::scanf("%" SCNd64, Slot);
+}
+
+// Like readFromREPLInput, for any number of digits
+void readBigFromREPLInput(int64_t *Slot) {
+    int C;
+    while ((C = std::getchar()) != EOF && llvm::isSpace(C))
+        ;
+    bool Negative = C == '-';
+    if (C == '-' || C == '+')
+        C = std::getchar();
+    if (!llvm::isDigit(C)) {
+        if (C != EOF)
+            std::ungetc(C, stdin);
+        return;
+    }
+    int64_t Value = calc_big_from_int(0);
+    int64_t Ten = calc_big_from_int(10);
+    for (; llvm::isDigit(C); C = std::getchar())
+        Value = calc_big_add(calc_big_mul(Value, Ten), calc_big_from_int(C - '0'));
+    if (C != EOF)
+        std::ungetc(C, stdin);
+    *Slot = Negative ? calc_big_neg(Value) : Value;
+}
+
+// Reads standard input a statement at a time. Each statement is compiled
+// into a small module of its own, added to one long-lived JIT session and
+// run right away. Variables are globals, so later statements see them.
+// Returns the exit status of the session.
+int runREPL(const char *Argv0) {
+    std::unique_ptr<llvm::orc::LLJIT> JIT = createJIT(Argv0, llvm::errs(),
+            InputPath.empty() ? readFromREPLInput : calc_read,
+            InputPath.empty() ? readBigFromREPLInput : calc_read_big);
+    if (!JIT)
+        return 1;
 
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr);
+    SymbolTable Symbols;
+    llvm::BitVector Globals;
+    bool Interactive = llvm::sys::Process::StandardInIsUserInput();
+    bool HasError = false;
+    unsigned NumStatements = 0;
+
+    // Our own output must come out before anything the program prints
+    llvm::outs().flush();
+    std::string Input;
+    for (;;) {
+        if (Interactive) {
+            std::fputs(Input.empty() ? "> " : "... ", stdout);
+            std::fflush(stdout);
+        }
+        bool AtEnd = !readLine(Input);
+        // Wait for the rest of a statement that spans several lines
+        if (!AtEnd && !llvm::StringRef(Input).rtrim().endswith(";"))
+            continue;
+        if (llvm::StringRef(Input).trim().empty()) {
+            Input.clear();
+            if (AtEnd) break;
+            continue;
+        }
+
+        unsigned BufferID = SrcMgr.AddNewSourceBuffer(
+                llvm::MemoryBuffer::getMemBufferCopy(Input, "<stdin>"), llvm::SMLoc());
+        Input.clear();
+        Lexer TheLexer(SrcMgr, Diags, Symbols, BufferID);
+        TheLexer.setBigint(Bigint);
+        Parser TheParser(TheLexer);
+        while (AST *Tree = TheParser.parse()) {
+            std::string Name = "calc.stmt." + std::to_string(NumStatements++);
+            CodeGen TheGenerator(TheParser);
+            TheGenerator.setBigint(Bigint);
+            TheGenerator.compileStatement(Tree, Name, JIT->getDataLayout(), Globals);
+            if (OptLevel != '0')
+                optimize(TheGenerator.getModule(), nullptr);
+
+            if (llvm::Error Err = JIT->addIRModule(TheGenerator.takeModule())) {
+                llvm::WithColor::error(llvm::errs(), Argv0) << llvm::toString(std::move(Err)) << '\n';
+                return 1;
+            }
+            auto StmtSym = JIT->lookup(Name);
+            if (!StmtSym) {
+                llvm::WithColor::error(llvm::errs(), Argv0) << llvm::toString(StmtSym.takeError()) << '\n';
+                return 1;
+            }
+            StmtSym->toPtr<void (*)()>()();
+        }
+        HasError |= TheParser.hasError();
+        calc_flush();
+        if (AtEnd) break;
+    }
+    return HasError ? 1 : 0;
+}
+
+// Compiles one input file from start to finish. Everything the file reports
+// goes to Errs so diagnostics of concurrently compiled files never mix.
+// TM is created on first use and reused by the caller for later files.
+// With Timers, every phase of the compile is timed.
+// Returns the exit status for this file.
+int compileFile(const char *Argv0, const std::string &F,
+        std::unique_ptr<llvm::TargetMachine> &TM, llvm::raw_ostream &Errs,
+        PhaseTimers *Timers = nullptr) {
+    auto getTimer = [Timers](PhaseTimers::Phase P) {
+        return Timers ? &Timers->get(P) : nullptr;
+    };
+    if (!llvm::StringRef(F).endswith(".calc")) {
+        llvm::WithColor::error(Errs, Argv0)
+            << "Input file must have .calc extension: " << F << '\n';
+        return 0;
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+        FileOrErr = llvm::MemoryBuffer::getFile(F);
+    if (std::error_code BufferError = FileOrErr.getError()) {
+        Errs << "Error reading " << F << ": " << BufferError.message() << '\n';
+        return 0;
+    }
+
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr, Errs);
+    SymbolTable Symbols;
+    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+    auto TheLexer = Lexer(SrcMgr, Diags, Symbols);
+    TheLexer.setBigint(Bigint);
+    auto TheParser = Parser(TheLexer);
+
+    if (Interpret) {
+        // Our own output must come out before anything the program prints
+        llvm::outs().flush();
+        Interpreter(TheParser).run();
+        return TheParser.hasError() ? 1 : 0;
+    }
+
+    if (RunVM || DumpBytecode) {
+        BytecodeProgram Program;
+        BytecodeGen(TheParser).compile(Program);
+        if (TheParser.hasError())
+            return 1;
+        if (DumpBytecode) {
+            Program.dump(llvm::outs());
+            return 0;
+        }
+        llvm::outs().flush();
+        VM(Program).run();
+        return 0;
+    }
+
+    bool UserSpecifiedOutput = EmitLLVM || EmitAsm || EmitObj;
+    llvm::CodeGenFileType FileType = (EmitLLVM || EmitAsm)
+        ? llvm::CGFT_AssemblyFile
+        : llvm::CGFT_ObjectFile;
+    std::string OutputFile;
+    if (!OutputFilename.empty())
+        OutputFile = OutputFilename.getValue();
+    else if (UserSpecifiedOutput)
+        OutputFile = getOutputFilename(F, FileType);
+    else
+        OutputFile = llvm::StringRef(F).drop_back(5).str();
+
+    // A file compiled the same way before is taken from the cache
+    std::string CacheKey;
+    if (Cache && !RunJIT && OutputFile != "-") {
+        llvm::StringRef Kind = !UserSpecifiedOutput ? "exe"
+            : EmitLLVM ? "ll" : EmitAsm ? "s" : "o";
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Cache));
+        CacheKey = getCacheKey(F,
+                SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())->getBuffer(), Kind);
+        if (Cache->fetch(CacheKey, OutputFile))
+            return 0;
+    }
+
+    auto TheGenerator = CodeGen(TheParser);
+    for (const auto &[Name, Value] : BoundInputs)
+        TheGenerator.bind(Symbols.intern(Name), Value);
+    TheGenerator.setTimers(Timers);
+    TheGenerator.setBigint(Bigint);
+
+    if (!TM)
+        TM.reset(createTargetMachine(Argv0, Errs));
+    if (!TM) {
+        Errs << "Failed to create the Target Machine\n";
+        return 1;
+    }
+    TheGenerator.compile(Argv0, F.c_str(), TM.get(), Batch, Freestanding);
+    if (TheParser.hasError())
+        return 1;
+
+    llvm::Module* M = TheGenerator.getModule();
+    if (!M) {
+        Errs << "Failed to get module from Code Generator";
+        return 1;
+    }
+
+    std::string VerifyErr;
+    llvm::raw_string_ostream VerifyStream(VerifyErr);
+    bool Broken;
+    {
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Verify));
+        Broken = llvm::verifyModule(*M, &VerifyStream);
+    }
+    if (Broken) {
+        Errs << "Module Verification Failed: " << VerifyStream.str() << '\n';
+        return 1;
+    }
+
+    {
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Optimize));
+        optimize(M, TM.get());
+    }
+
+    if (RunJIT) {
+        int ExitCode;
+        if (!runJIT(Argv0, TheGenerator.takeModule(), ExitCode, Errs)) return 1;
+        return ExitCode;
+    }
+
+    if (UserSpecifiedOutput) {
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Emit));
+        if (!emit(Argv0, M, TM.get(), OutputFile, FileType, Errs)) return 1;
+    } else {
+        std::string ObjectFile = getOutputFilename(F, llvm::CGFT_ObjectFile);
+        {
+            llvm::TimeRegion Region(getTimer(PhaseTimers::Emit));
+            if (!emit(Argv0, M, TM.get(), ObjectFile, llvm::CGFT_ObjectFile, Errs)) return 1;
+        }
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Link));
+        if (!linkExecutable(Argv0, ObjectFile, OutputFile, TM->getTargetTriple(), Errs)) return 1;
+
+        llvm::sys::fs::remove(ObjectFile);
+    }
+    if (!CacheKey.empty()) {
+        llvm::TimeRegion Region(getTimer(PhaseTimers::Cache));
+        Cache->store(CacheKey, OutputFile);
+    }
+    return 0;
+}
+
+// Makes the native target available to code generation and the JIT
+void initializeTargets() {
     // Native targeting asm for prototyping
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
@@ -162,79 +889,248 @@ int main(int argc_, const char **argv_) {
     llvm::InitializeAllAsmParsers();
     llvm::InitializeAllAsmPrinters();
     */
+}
 
-    llvm::cl::ParseCommandLineOptions(argc_, argv_, "Calc compiler\n");
-    
-    for (unsigned i = 0; i < InputFiles.size(); ++i) {
-        std::string F = InputFiles[i];
-        if (!llvm::StringRef(F).endswith(".calc")) {
-            llvm::WithColor::error(llvm::errs(), argv_[0])
-                << "Input file must have .calc extension: " << F << '\n';
-            continue;
-        }
-
-        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
-            FileOrErr = llvm::MemoryBuffer::getFile(F);
-        if (std::error_code BufferError = FileOrErr.getError()) {
-            llvm::errs() << "Error reading " << F << ": " << BufferError.message() << '\n';
-            continue;
-        }
+// Everything createTargetMachine depends on, so a server only reuses a
+// target machine for requests that would create the same one
+std::string getTargetKey() {
+    std::optional<llvm::Reloc::Model> RelocModel = llvm::codegen::getRelocModel();
+    std::vector<std::string> Parts = {
+        MTriple,
+        llvm::codegen::getMArch(),
+        llvm::codegen::getCPUStr(),
+        llvm::codegen::getFeaturesStr(),
+        std::to_string(RelocModel ? static_cast<int>(*RelocModel) : -1),
+        std::string(1, OptLevel),
+        Freestanding ? "freestanding" : "",
+    };
+    return llvm::join(Parts, "\n");
+}
 
-        llvm::SourceMgr SrcMgr;
-        DiagnosticsEngine Diags(SrcMgr);
-        SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
-        auto TheLexer = Lexer(SrcMgr, Diags);
-        auto TheParser = Parser(TheLexer);
-        auto TheGenerator = CodeGen(TheParser);
+// Compiles the input files of the parsed command line. The first target
+// machine needed is created in TM, unless TM already holds one.
+int runCompiler(const char *Argv0, std::unique_ptr<llvm::TargetMachine> &TM) {
+    if (OptLevel < '0' || OptLevel > '3') {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Invalid optimization level: -O" << OptLevel << '\n';
+        return 1;
+    }
 
-        llvm::TargetMachine* TM = createTargetMachine(argv_[0]);
-        if (!TM) {
-            llvm::errs() << "Failed to create the Target Machine\n";
+    // The interpreter and the VM never touch a target, so they skip their setup
+    if (usesLLVMBackend())
+        initializeTargets();
+#ifndef CALC_HAVE_LLD
+    if (Linker == LLDLinker) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "This compiler was built without LLD, use --linker=gcc\n";
+        return 1;
+    }
+#endif
+    if (!parseBindings(Argv0))
+        return 1;
+    if (!BoundInputs.empty() && (Repl || !usesLLVMBackend())) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "--bind only applies to programs compiled with LLVM\n";
+        return 1;
+    }
+    if (Batch && (Repl || !usesLLVMBackend())) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "--batch only applies to programs compiled with LLVM\n";
+        return 1;
+    }
+    if (Bigint && !usesLLVMBackend()) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "--bigint only applies to programs compiled with LLVM\n";
+        return 1;
+    }
+    if (Bigint && Batch) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "--bigint does not apply to --batch programs, which keep values in fixed-size columns\n";
+        return 1;
+    }
+    if ((TimeReport || !TimeReportJSON.empty()) && (Repl || !usesLLVMBackend())) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "-time-report only applies to programs compiled with LLVM\n";
+        return 1;
+    }
+    if (Freestanding) {
+        llvm::Triple Triple(!MTriple.empty()
+                ? llvm::Triple::normalize(MTriple)
+                : llvm::sys::getDefaultTargetTriple());
+        if (Repl || RunJIT || !usesLLVMBackend()) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "--freestanding only applies to compiled executables\n";
             return 1;
         }
-        TheGenerator.compile(argv_[0], F.c_str(), TM);
-
-        llvm::Module* M = TheGenerator.getModule();
-        if (!M) {
-            llvm::errs() << "Failed to get module from Code Generator";
+        if (!Triple.isOSLinux() ||
+                (Triple.getArch() != llvm::Triple::x86_64 &&
+                 Triple.getArch() != llvm::Triple::aarch64)) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "--freestanding only supports x86_64 and aarch64 Linux\n";
             return 1;
         }
+    }
+    if (!InputPath.empty() && calc_set_input(InputPath.c_str()) != 0) {
+        std::error_code EC(errno, std::generic_category());
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot read " << InputPath << ": " << EC.message() << '\n';
+        return 1;
+    }
 
-        std::string VerifyErr;
-        llvm::raw_string_ostream VerifyStream(VerifyErr);
-        if (llvm::verifyModule(*M, &VerifyStream)) {
-            llvm::errs() << "Module Verification Failed: " << VerifyStream.str() << '\n';
+    if (Repl) {
+        if (!InputFiles.empty()) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "Cannot specify input files with --repl\n";
             return 1;
         }
+        return runREPL(Argv0);
+    }
+    if (InputFiles.empty()) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "No input files\n";
+        return 1;
+    }
+    if (!OutputFilename.empty() && InputFiles.size() > 1) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot specify -o with multiple input files\n";
+        return 1;
+    }
 
-        bool userSpecifiedOutput = EmitLLVM || EmitAsm || EmitObj;
-        if (userSpecifiedOutput) {
-            if (EmitLLVM || EmitAsm)
-                FileType = llvm::CGFT_AssemblyFile;
-            else if (EmitObj)
-                FileType = llvm::CGFT_ObjectFile;
-            if (!emit(argv_[0], M, TM, F)) return 1;
+    std::string CacheDirectory = CacheDir;
+    if (CacheDirectory.empty())
+        CacheDirectory = llvm::sys::Process::GetEnv("CALC_CACHE_DIR").value_or("");
+    llvm::Expected<llvm::CachePruningPolicy> Policy =
+        llvm::parseCachePruningPolicy(CachePolicy);
+    if (!Policy) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Invalid cache policy: " << llvm::toString(Policy.takeError()) << '\n';
+        return 1;
+    }
+    if (!CacheDirectory.empty() && usesLLVMBackend() && !RunJIT) {
+        Cache = std::make_unique<CompileCache>(CacheDirectory);
+        std::string Error;
+        if (Cache->init(Error)) {
+            CompilerID = getCompilerID(Argv0);
         } else {
-            llvm::StringRef InputRef(F);
-            std::string ObjectFile = InputRef.drop_back(5).str() + ".o";
+            llvm::WithColor::warning(llvm::errs(), Argv0)
+                << "Not caching, cannot use " << CacheDirectory << ": " << Error << '\n';
+            Cache.reset();
+        }
+    }
+    // One set of timers per file, since files may be compiled in parallel
+    std::vector<std::unique_ptr<PhaseTimers>> Timers;
+    if ((TimeReport || !TimeReportJSON.empty()) && usesLLVMBackend())
+        for (const std::string &F : InputFiles)
+            Timers.push_back(std::make_unique<PhaseTimers>(F));
+    auto getTimers = [&](unsigned i) {
+        return Timers.empty() ? nullptr : Timers[i].get();
+    };
 
-            std::string SavedOutput = OutputFilename.getValue();
-            OutputFilename = ObjectFile;
-            FileType = llvm::CGFT_ObjectFile;
-            if (!emit(argv_[0], M, TM, F)) return 1;
+    // Runs once all files are compiled, whatever the result
+    auto finish = [&](int Result) {
+        if (!reportTimes(Argv0, Timers) && Result == 0)
+            Result = 1;
+        if (Cache) {
+            Cache->prune(*Policy);
+            if (CacheStats)
+                llvm::errs() << "Cache: " << Cache->getHits() << " hits, "
+                    << Cache->getMisses() << " misses\n";
+        }
+        return Result;
+    };
 
-            OutputFilename = SavedOutput;
-            std::string ExeName;
-            if (!OutputFilename.empty())
-                ExeName = OutputFilename.getValue();
-            else
-                ExeName = InputRef.drop_back(5).str();
+    std::vector<int> Results(InputFiles.size(), 0);
 
-            if (!linkExecutable(argv_[0], ObjectFile, ExeName)) return 1;
+    // Programs run in-process write to our stdout, so they are never run
+    // side by side
+    if (Jobs <= 1 || RunJIT || !usesLLVMBackend()) {
+        for (unsigned i = 0; i < InputFiles.size(); ++i) {
+            Results[i] = compileFile(Argv0, InputFiles[i], TM, llvm::errs(),
+                    getTimers(i));
+            if (Results[i] != 0) return finish(Results[i]);
+        }
+        return finish(0);
+    }
+
+    std::mutex ErrsLock;
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Jobs));
+    for (unsigned i = 0; i < InputFiles.size(); ++i) {
+        Pool.async([&, i] {
+            // Each worker keeps one target machine for all of its files
+            static thread_local std::unique_ptr<llvm::TargetMachine> TM;
+            std::string Diagnostics;
+            llvm::raw_string_ostream Errs(Diagnostics);
+            Results[i] = compileFile(Argv0, InputFiles[i], TM, Errs, getTimers(i));
 
-            llvm::sys::fs::remove(ObjectFile);
+            std::lock_guard<std::mutex> Guard(ErrsLock);
+            llvm::errs() << Errs.str();
+        });
+    }
+    Pool.wait();
+
+    for (int Result : Results)
+        if (Result != 0) return finish(Result);
+    return finish(0);
+}
+
+// Options that print something and exit
+bool isInformational(llvm::StringRef Arg) {
+    llvm::StringRef Name = Arg.ltrim('-');
+    return Arg.startswith("-") &&
+        (Name.startswith("help") || Name.startswith("print-") || Name == "version");
+}
+
+// Target machines for the default target at every optimization level.
+// The server creates them once, and every request starts with a copy.
+static std::map<std::string, std::unique_ptr<llvm::TargetMachine>> WarmTargetMachines;
+
+// Handles one request of a client, in a process of its own that only
+// parsed --server so far
+int serveRequest(llvm::ArrayRef<const char *> Args) {
+    llvm::cl::ResetAllOptionOccurrences();
+    llvm::outs() << "Calc " << "Version " << CalcVersion << '\n';
+    // Exiting early would leave the client without a status
+    if (llvm::any_of(Args.drop_front(), isInformational)) {
+        llvm::WithColor::error(llvm::errs(), Args[0])
+            << "Run calc itself for its help and version\n";
+        return 1;
+    }
+    if (!llvm::cl::ParseCommandLineOptions(Args.size(), Args.data(), "Calc compiler\n", &llvm::errs()))
+        return 1;
+    if (ServerSocket.getNumOccurrences()) {
+        llvm::WithColor::error(llvm::errs(), Args[0])
+            << "A client cannot start another server\n";
+        return 1;
+    }
+
+    std::unique_ptr<llvm::TargetMachine> TM;
+    auto Warm = WarmTargetMachines.find(getTargetKey());
+    if (Warm != WarmTargetMachines.end())
+        TM = std::move(Warm->second);
+    return runCompiler(Args[0], TM);
+}
+
+int main(int argc_, const char **argv_) {
+    llvm::InitLLVM X(argc_, argv_);
+    static llvm::codegen::RegisterCodeGenFlags CGF;
+    llvm::outs() << "Calc " << "Version " << CalcVersion << '\n';
+
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "Calc compiler\n");
+    if (!ServerSocket.empty()) {
+        if (!InputFiles.empty()) {
+            llvm::WithColor::error(llvm::errs(), argv_[0])
+                << "The server compiles the files its clients send, not input files of its own\n";
+            return 1;
+        }
+        // Setting up the target once is what makes every request faster
+        initializeTargets();
+        for (char Level : {'0', '1', '2', '3'}) {
+            OptLevel = Level;
+            WarmTargetMachines[getTargetKey()].reset(createTargetMachine(argv_[0], llvm::errs()));
         }
+        return runServer(argv_[0], ServerSocket, serveRequest);
     }
 
-    return 0;
+    std::unique_ptr<llvm::TargetMachine> TM;
+    return runCompiler(argv_[0], TM);
 }
@@ -3,19 +3,62 @@
 
 #include <calc/Parser/AST.h>
 #include <calc/Parser/Parser.h>
+#include <calc/Utils/PhaseTimers.h>
+#include "llvm/ADT/BitVector.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/Target/TargetMachine.h"
+#include <utility>
+#include <vector>
 
 class CodeGen {
     Parser& parser;
-    llvm::LLVMContext Ctx;
+    std::unique_ptr<llvm::LLVMContext> Ctx;
     std::unique_ptr<llvm::Module> M;
+    std::vector<std::pair<calc::SymbolTable::SymbolID, int64_t>> Bindings;
+    calc::PhaseTimers *Timers = nullptr;
+    bool Bigint = false;
 
 public:
-    CodeGen(Parser &parser) : parser(parser) { }
-    void compile(const char* Argv0, const char* F, llvm::TargetMachine* TM);
+    CodeGen(Parser &parser)
+        : parser(parser), Ctx(std::make_unique<llvm::LLVMContext>()) { }
+    // With Batch, main runs the program once for every record of values
+    // in the input instead of once in total. A record holds one value per
+    // read statement.
+    // With Freestanding, the module also starts itself at _start, for
+    // executables linked without the C library.
+    void compile(const char* Argv0, const char* F, llvm::TargetMachine* TM,
+            bool Batch = false, bool Freestanding = false);
+
+    // Specializes the program compiled next: every read of the variable
+    // produces Value as if it had been typed in.
+    void bind(calc::SymbolTable::SymbolID ID, int64_t Value) {
+        Bindings.emplace_back(ID, Value);
+    }
+
+    // Makes integers as large as they need to be instead of wrapping
+    // around at 64 bits. Values are passed to the calc_big functions of
+    // the runtime, and only the overflow of a small value calls them.
+    // Not for batch programs.
+    void setBigint(bool B) { Bigint = B; }
+
+    // Splits the time compile spends between parsing and generating IR
+    void setTimers(calc::PhaseTimers *T) { Timers = T; }
+
+    // Compiles a single statement into a module of its own, holding one
+    // function FnName that runs it. Variables are globals shared by every
+    // module compiled this way; Globals marks the ones a module has already
+    // defined and is updated by each call.
+    void compileStatement(AST* Tree, llvm::StringRef FnName,
+            const llvm::DataLayout& DL, llvm::BitVector& Globals);
     llvm::Module* getModule() { return M.get(); }
+
+    // Hands the module and its context over to the JIT.
+    // The generator is left without a module afterwards.
+    llvm::orc::ThreadSafeModule takeModule() {
+        return llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx));
+    }
 };
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef CALC_GENERATOR_INTERPRETER_H
+#define CALC_GENERATOR_INTERPRETER_H
+
+#include <calc/Parser/AST.h>
+#include <calc/Parser/Parser.h>
+
+// Evaluates the program straight from its ASTs without going through LLVM.
+// The output is identical to what the compiled executable prints.
+class Interpreter {
+    Parser& parser;
+
+public:
+    Interpreter(Parser &parser) : parser(parser) { }
+    void run();
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CALC_GENERATOR_PARTIALEVALUATOR_H
+#define CALC_GENERATOR_PARTIALEVALUATOR_H
+
+#include <calc/Utils/SymbolTable.h>
+#include <calc/Utils/TokenKinds.h>
+#include "llvm/ADT/BitVector.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runs the part of a program that does not depend on its input while the
+// program is being compiled. The code generator asks it for the value of
+// every variable and only emits code for the values it does not know.
+// Whatever the known statements print is collected as text, so the
+// generated code can write it out in one piece.
+class PartialEvaluator {
+    // Compile-time value of each symbol, where Known is set
+    std::vector<int64_t> Values;
+    llvm::BitVector Known;
+    // The value every read of a symbol produces, where Bound is set
+    std::vector<int64_t> Bindings;
+    llvm::BitVector Bound;
+    // Printed by known statements and not yet written out
+    std::string Output;
+
+public:
+    using SymbolID = calc::SymbolTable::SymbolID;
+
+    // Makes room for the symbols the lexer has added since the last call
+    void resize(size_t NumSymbols);
+
+    bool isKnown(SymbolID ID) const { return Known.test(ID); }
+    int64_t getValue(SymbolID ID) const { return Values[ID]; }
+    void setValue(SymbolID ID, int64_t Value) {
+        Values[ID] = Value;
+        Known.set(ID);
+    }
+    void forget(SymbolID ID) { Known.reset(ID); }
+
+    // Specializes the program for an input that is known ahead of time
+    void bind(SymbolID ID, int64_t Value);
+    bool isBound(SymbolID ID) const { return Bound.test(ID); }
+    int64_t getBinding(SymbolID ID) const { return Bindings[ID]; }
+
+    // Appends exactly what calc_print would print for Value
+    void print(int64_t Value);
+    const std::string &getOutput() const { return Output; }
+    void clearOutput() { Output.clear(); }
+
+    // The arithmetic of the language, for binary operators and compound
+    // assignments. Values wrap around like the i64 instructions of the
+    // generated code.
+    static int64_t fold(calc::tok::TokenKind Op, int64_t LHS, int64_t RHS);
+    static int64_t negate(int64_t Value);
+
+    // The same arithmetic for integers of any size, as in programs
+    // compiled with --bigint. Returns false where the result does not fit
+    // in 64 bits after all, so it is left to the generated code.
+    static bool foldExact(calc::tok::TokenKind Op, int64_t LHS, int64_t RHS,
+            int64_t &Result);
+};
+
+#endif
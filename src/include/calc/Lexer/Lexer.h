@@ -3,34 +3,79 @@
 
 #include <calc/Utils/Token.h>
 #include <calc/Utils/Diagnostics.h>
+#include <calc/Utils/SymbolTable.h>
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include <cassert>
 //#include <iostream>
 
 class Lexer {
+public:
+    // How far past the next token the parser may look.
+    static constexpr unsigned MaxLookAhead = 4;
+
+private:
     const char *BufferPtr;
+    const char *BufferEnd;
     const llvm::SourceMgr &SrcMgr;
     calc::DiagnosticsEngine &Diag;
+    calc::SymbolTable &Symbols;
+    // Tokens already lexed but not yet handed out by next(), oldest at
+    // Head. Each token is lexed exactly once, however often it is peeked.
+    Token Ahead[MaxLookAhead];
+    unsigned Head = 0;
+    unsigned NumAhead = 0;
+    bool Bigint = false;
 
 public:
-    Lexer(const llvm::SourceMgr &SrcMgr, calc::DiagnosticsEngine &Diag) :
-    SrcMgr(SrcMgr), Diag(Diag) {
-        const llvm::MemoryBuffer *Buffer = SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID());
+    // Lexes the buffer BufferID of SrcMgr, by default the main file.
+    Lexer(const llvm::SourceMgr &SrcMgr, calc::DiagnosticsEngine &Diag,
+            calc::SymbolTable &Symbols, unsigned BufferID = 0) :
+    SrcMgr(SrcMgr), Diag(Diag), Symbols(Symbols) {
+        if (!BufferID)
+            BufferID = SrcMgr.getMainFileID();
+        const llvm::MemoryBuffer *Buffer = SrcMgr.getMemoryBuffer(BufferID);
         const char *BufferStart = Buffer->getBufferStart();
         BufferPtr = BufferStart;
+        BufferEnd = Buffer->getBufferEnd();
     }
 
     calc::DiagnosticsEngine &getDiagnostics() const {
         return Diag;
     }
 
-    void next (Token &token);
+    calc::SymbolTable &getSymbols() const {
+        return Symbols;
+    }
+
+    // With Bigint, an integer literal too large for 64 bits is a
+    // BIG_INTEGER_LITERAL instead of an error
+    void setBigint(bool Enable) { Bigint = Enable; }
+
+    void next(Token &token) {
+        if (NumAhead == 0) {
+            lex(token);
+            return;
+        }
+        token = Ahead[Head];
+        Head = (Head + 1) % MaxLookAhead;
+        --NumAhead;
+    }
 
-    tok::TokenKind peek();
+    // The token N places after the one the next call to next() returns.
+    const Token &peek(unsigned N = 0) {
+        assert(N < MaxLookAhead && "Peeking too far ahead");
+        while (NumAhead <= N) {
+            lex(Ahead[(Head + NumAhead) % MaxLookAhead]);
+            ++NumAhead;
+        }
+        return Ahead[(Head + N) % MaxLookAhead];
+    }
 
 private:
+    void lex(Token &token);
     void formToken(Token &Result, const char *TokEnd, tok::TokenKind Kind);
     llvm::SMLoc getLoc() { return llvm::SMLoc::getFromPointer(BufferPtr); }
 };
@@ -2,8 +2,8 @@
 #define CALC_AST_AST_H
 
 #include <calc/Utils/Token.h>
+#include <calc/Utils/SymbolTable.h>
 #include "llvm/ADT/StringRef.h"
-#include <memory>
 #include <iostream>
 #include <string>
 
@@ -14,6 +14,7 @@ class BinaryOp;
 class UnaryOp;
 class Grouping;
 class Literal;
+class BigLiteral;
 class Variable;
 class Assign;
 
@@ -31,6 +32,7 @@ class ASTVisitor {
         virtual void visit(UnaryOp &) = 0;
         virtual void visit(Grouping &) = 0;
         virtual void visit(Literal &) = 0;
+        virtual void visit(BigLiteral &) = 0;
         virtual void visit(Variable &) = 0;
         virtual void visit(Assign &) = 0;
 
@@ -43,136 +45,215 @@ class ASTVisitor {
 
 class AST {
     public:
-        virtual ~AST() {}
+        // Discriminator for LLVM-style isa/dyn_cast, which work without RTTI
+        enum ASTKind : unsigned char {
+            AK_BinaryOp,
+            AK_UnaryOp,
+            AK_Grouping,
+            AK_Literal,
+            AK_BigLiteral,
+            AK_Variable,
+            AK_Assign,
+            AK_Declare,
+            AK_ExprStmt,
+            AK_Read
+        };
+
+    private:
+        const ASTKind Kind;
+
+    public:
+        AST(ASTKind Kind) : Kind(Kind) {}
+        ASTKind getKind() const { return Kind; }
+        // ASTs live in the parser's arena and are freed all at once, so no
+        // destructor is ever run on them
         virtual void accept(ASTVisitor &V) = 0;
 };
 
 class Expr : public AST {
+        // Fits next to the kind, so it makes no AST any bigger
+        uint16_t ID = NoID;
+
     public:
-        Expr() {}
+        // The expressions the parser shares are numbered from 0 up, so a
+        // pass can keep what it knows about each of them in a vector. The
+        // numbers start over with every sharing window of the parser.
+        static constexpr uint16_t NoID = 0xFFFF;
+
+        Expr(ASTKind Kind) : AST(Kind) {}
+        uint16_t getID() const { return ID; }
+        void setID(uint16_t I) { ID = I; }
         virtual void print(int indent = 0) = 0;
+        static bool classof(const AST *N) {
+            return N->getKind() >= AK_BinaryOp && N->getKind() <= AK_Assign;
+        }
 };
 
 // TermExpr
 class BinaryOp : public Expr {
-    std::unique_ptr<Expr> left;
-    Token op;
-    std::unique_ptr<Expr> right;
+    Expr *left;
+    tok::TokenKind op;
+    Expr *right;
 
     public:
-        BinaryOp(std::unique_ptr<Expr> left, const Token& op, std::unique_ptr<Expr> right) 
-            : left(std::move(left)), op(op), right(std::move(right)) {}
-        Expr* getLeft() { return left.get(); }
-        Expr* getRight() { return right.get(); }
-        Token getOp() { return op; }
+        BinaryOp(Expr *left, tok::TokenKind op, Expr *right) 
+            : Expr(AK_BinaryOp), left(left), op(op), right(right) {}
+        Expr* getLeft() { return left; }
+        Expr* getRight() { return right; }
+        tok::TokenKind getOp() { return op; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_BinaryOp;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Binary Op: (" << op.getLexeme().str() << ")" << std::endl;
+            std::cout << std::string(indent, ' ') << "Binary Op: (" << tok::getPunctuatorSpelling(op) << ")" << std::endl;
             if (left) left->print(indent + 2);
             if (right) right->print(indent + 2);
         }
 };
 
 class UnaryOp : public Expr {
-    Token op;
-    std::unique_ptr<Expr> expr;
+    tok::TokenKind op;
+    Expr *expr;
 
     public:
-        UnaryOp(const Token& op, std::unique_ptr<Expr> expr)
-            : op(op), expr(std::move(expr)) {}
-        Token getOp() { return op; }
-        Expr* getExpr() { return expr.get(); }
+        UnaryOp(tok::TokenKind op, Expr *expr)
+            : Expr(AK_UnaryOp), op(op), expr(expr) {}
+        tok::TokenKind getOp() { return op; }
+        Expr* getExpr() { return expr; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_UnaryOp;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Unary Op: (" << op.getLexeme().str() << ")" << std::endl;
+            std::cout << std::string(indent, ' ') << "Unary Op: (" << tok::getPunctuatorSpelling(op) << ")" << std::endl;
             if (expr) expr->print(indent + 2);
         }
 };
 
 class Grouping : public Expr {
-    std::unique_ptr<Expr> expr;
+    Expr *expr;
 
     public:
-        Grouping(std::unique_ptr<Expr> expr) : expr(std::move(expr)) {}
-        Expr* getExpr() { return expr.get(); }
+        Grouping(Expr *expr) : Expr(AK_Grouping), expr(expr) {}
+        Expr* getExpr() { return expr; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Grouping;
+        }
         virtual void print(int indent = 0) override {
             std::cout << std::string(indent, ' ') << "Grouping:" << std::endl;
             if (expr) expr->print(indent + 2);
         }
 };
 
+// Literals hold the value the lexer decoded. Names are kept as their ID in
+// the symbol table.
 class Literal : public Expr {
-    Token literal;
+    uint64_t value;
+
+    public:
+        Literal(uint64_t value) : Expr(AK_Literal), value(value) {}
+        uint64_t getValue() { return value; }
+        virtual void accept(ASTVisitor &V) override {
+            V.visit(*this);
+        }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Literal;
+        }
+        virtual void print(int indent = 0) override {
+            std::cout << std::string(indent, ' ') << "Literal: (" << static_cast<int64_t>(value) << ')' << std::endl;
+        }
+};
+
+// A literal too large for 64 bits, in programs compiled with --bigint. It
+// keeps its digits, and the generated code makes the number from them.
+class BigLiteral : public Expr {
+    llvm::StringRef digits;
 
     public:
-        Literal(const Token& tok) : literal(tok) {}
-        llvm::StringRef getData() { return literal.getLiteralData(); }
+        BigLiteral(llvm::StringRef digits) : Expr(AK_BigLiteral), digits(digits) {}
+        llvm::StringRef getDigits() { return digits; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_BigLiteral;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Literal: (" << literal.getLiteralData().str() << ')' << std::endl;
+            std::cout << std::string(indent, ' ') << "Literal: (" << digits.str() << ')' << std::endl;
         }
 };
 
 class Variable : public Expr {
-    Token identifier;
+    calc::SymbolTable::SymbolID identifier;
 
     public:
-        Variable(const Token& tok) : identifier(tok) {}
-        llvm::StringRef getData() { return identifier.getIdentifier(); }
+        Variable(calc::SymbolTable::SymbolID identifier) : Expr(AK_Variable), identifier(identifier) {}
+        calc::SymbolTable::SymbolID getSymbol() { return identifier; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Variable;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Identifier: (" << identifier.getIdentifier().str() << ')' << std::endl;
+            std::cout << std::string(indent, ' ') << "Identifier: (#" << identifier << ')' << std::endl;
         }
 };
 
 class Assign : public Expr {
-    Token identifier;
-    Token op;
-    std::unique_ptr<Expr> expr;
+    calc::SymbolTable::SymbolID identifier;
+    tok::TokenKind op;
+    Expr *expr;
 
     public:
-        Assign(Token identifier, const Token& op, std::unique_ptr<Expr> expr)
-            : identifier(identifier), op(op), expr(std::move(expr)) {}
-        Token getIdentifier() { return identifier; }
-        Token getOp() { return op; }
-        Expr* getExpr() { return expr.get(); }
+        Assign(calc::SymbolTable::SymbolID identifier, tok::TokenKind op, Expr *expr)
+            : Expr(AK_Assign), identifier(identifier), op(op), expr(expr) {}
+        calc::SymbolTable::SymbolID getSymbol() { return identifier; }
+        tok::TokenKind getOp() { return op; }
+        Expr* getExpr() { return expr; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Assign;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Assign: (" << identifier.getIdentifier().str() << ")" << std::endl;
-            std::cout << std::string(indent + 2, ' ') << "Op: (" << op.getLexeme().str() << ")" << std::endl;
+            std::cout << std::string(indent, ' ') << "Assign: (#" << identifier << ")" << std::endl;
+            std::cout << std::string(indent + 2, ' ') << "Op: (" << tok::getPunctuatorSpelling(op) << ")" << std::endl;
             if (expr) expr->print(indent + 2);
         }
 };
 
 class Stmt : public AST {
     public:
-        Stmt() {}
+        Stmt(ASTKind Kind) : AST(Kind) {}
         virtual void print(int indent = 0) = 0;
+        static bool classof(const AST *N) {
+            return N->getKind() >= AK_Declare && N->getKind() <= AK_Read;
+        }
 };
 
 class Declare : public Stmt {
-    std::unique_ptr<Expr> expr;
+    Expr *expr;
 
     public:
-        Declare(std::unique_ptr<Expr> expr)
-            : expr(std::move(expr)) {}
-        Expr* getExpr() { return expr.get(); }
+        Declare(Expr *expr)
+            : Stmt(AK_Declare), expr(expr) {}
+        Expr* getExpr() { return expr; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Declare;
+        }
         virtual void print(int indent = 0) override {
             std::cout << std::string(indent, ' ') << "Declare: " << "\n";
             if (expr) expr->print(indent + 2);
@@ -180,14 +261,17 @@ class Declare : public Stmt {
 };
 
 class ExprStmt : public Stmt {
-    std::unique_ptr<Expr> expr;
+    Expr *expr;
 
     public:
-        ExprStmt(std::unique_ptr<Expr> expr) : expr(std::move(expr)) {}
-        Expr* getExpr() { return expr.get(); }
+        ExprStmt(Expr *expr) : Stmt(AK_ExprStmt), expr(expr) {}
+        Expr* getExpr() { return expr; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_ExprStmt;
+        }
         virtual void print(int indent = 0) override {
             std::cout << std::string(indent, ' ') << "Expr: \n";
             if (expr) expr->print(indent + 2);
@@ -195,17 +279,20 @@ class ExprStmt : public Stmt {
 };
 
 class Read : public Stmt {
-    Token identifier;
+    calc::SymbolTable::SymbolID identifier;
 
     public:
-        Read(const Token& identifier)
-            : identifier(identifier) {}
-        Token getIdentifier() { return identifier; }
+        Read(calc::SymbolTable::SymbolID identifier)
+            : Stmt(AK_Read), identifier(identifier) {}
+        calc::SymbolTable::SymbolID getSymbol() { return identifier; }
         virtual void accept(ASTVisitor &V) override {
             V.visit(*this);
         }
+        static bool classof(const AST *N) {
+            return N->getKind() == AK_Read;
+        }
         virtual void print(int indent = 0) override {
-            std::cout << std::string(indent, ' ') << "Read: " << identifier.getLexeme().str() << std::endl;
+            std::cout << std::string(indent, ' ') << "Read: #" << identifier << std::endl;
         }
 };
 
@@ -0,0 +1,72 @@
+#ifndef CALC_PARSER_FLATAST_H
+#define CALC_PARSER_FLATAST_H
+
+#include <calc/Parser/AST.h>
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <vector>
+
+// A flattened copy of the ASTs for the passes that walk every node.
+// Nodes are stored as a structure of arrays in post-order, so the children
+// of a node always come before it and a single forward loop sees every
+// operand before it is used. Groupings disappear during flattening.
+//
+// The parser shares the nodes of identical expressions, and so does the
+// flat copy: an expression that was appended before, by this statement or
+// an earlier one, is not appended again, and its parent refers back to the
+// first copy. A backend that keeps the values of earlier nodes thereby
+// computes every shared expression once. The parser only shares within a
+// window of recent statements, so a FlatAST is cleared whenever
+// Parser::sharesWithEarlier says the next statement starts a new one.
+//
+// Per node kind:
+//   BinaryOp  Op, LHS, RHS
+//   UnaryOp   Op, LHS
+//   Literal   Payload = value
+//   BigLiteral Payload = index of its digits, see getDigits
+//   Variable  Payload = symbol ID
+//   Assign    Op, LHS = value, Payload = symbol ID
+//   Declare   LHS = assignment
+//   ExprStmt  LHS = expression
+//   Read      Payload = symbol ID
+class FlatAST {
+public:
+    using NodeIndex = uint32_t;
+
+private:
+    std::vector<AST::ASTKind> Kinds;
+    std::vector<tok::TokenKind> Ops;
+    std::vector<NodeIndex> LHS;
+    std::vector<NodeIndex> RHS;
+    std::vector<uint64_t> Payload;
+    std::vector<llvm::StringRef> Digits;
+    // Where every shared expression was appended, by its ID, or NoNode.
+    // The IDs are those of one sharing window of one parser, so a FlatAST
+    // only holds the ASTs of a single window.
+    static constexpr NodeIndex NoNode = ~0u;
+    std::vector<NodeIndex> Flattened;
+
+    NodeIndex addNode(AST::ASTKind Kind, tok::TokenKind Op,
+            NodeIndex L, NodeIndex R, uint64_t Data);
+    bool lookup(Expr *E, NodeIndex &I) const;
+    NodeIndex remember(Expr *E, NodeIndex I);
+    NodeIndex flatten(Expr *Root);
+
+public:
+    size_t size() const { return Kinds.size(); }
+
+    AST::ASTKind getKind(NodeIndex I) const { return Kinds[I]; }
+    tok::TokenKind getOp(NodeIndex I) const { return Ops[I]; }
+    NodeIndex getLHS(NodeIndex I) const { return LHS[I]; }
+    NodeIndex getRHS(NodeIndex I) const { return RHS[I]; }
+    uint64_t getPayload(NodeIndex I) const { return Payload[I]; }
+    llvm::StringRef getDigits(NodeIndex I) const { return Digits[Payload[I]]; }
+
+    // Appends the nodes of a statement that are not here yet, and returns
+    // the index of its root
+    NodeIndex append(AST *Tree);
+    // Drops all nodes but keeps the allocated storage
+    void clear();
+};
+
+#endif
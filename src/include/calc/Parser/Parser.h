@@ -5,19 +5,111 @@
 #include <calc/Parser/AST.h>
 #include <calc/Lexer/Lexer.h>
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Casting.h"
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class Parser {
     Lexer &Lex;
     Token Tok;
     bool HasError;
-    llvm::SmallVector<llvm::StringRef, 256> declaredIdentifiers;
+    // Owns every AST of the compilation. They are all freed together when
+    // the parser goes away.
+    llvm::BumpPtrAllocator Allocator;
+
+    template <typename T, typename... Args>
+    T *create(Args &&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                "ASTs are never destroyed, only freed with the arena");
+        return new (Allocator.Allocate<T>()) T(std::forward<Args>(args)...);
+    }
+
+    // Every distinct expression is built once, and repeating it reuses the
+    // same node. An operator is the same expression as another one with the
+    // same kind, operator and children. A variable only stays the same
+    // expression while it holds the same value, so assigning or reading it
+    // drops its node and the next use builds a new one.
+    using OpKey = std::tuple<unsigned, const Expr *, const Expr *>;
+    llvm::DenseMap<OpKey, Expr *> Operations;
+    llvm::DenseMap<uint64_t, Expr *> Literals;
+    std::vector<Expr *> Variables;
+    uint32_t NumShared = 0;
+    bool Sharing = false;
+    // Sharing only reaches back over the statements that made the last
+    // SharingWindow or so shared nodes. Then the tables are dropped, which
+    // keeps them small, and the backends can drop what they kept of the
+    // statements before. The nodes of a statement that goes past
+    // Expr::NoID are still shared, but get no ID and are flattened again
+    // at every use.
+    static constexpr uint32_t SharingWindow = 1 << 14;
+    bool SharesWithEarlier = false;
+    bool WindowStarted = true;
+
+    void forgetShared() {
+        Operations.clear();
+        Literals.clear();
+        std::fill(Variables.begin(), Variables.end(), nullptr);
+        NumShared = 0;
+        WindowStarted = true;
+    }
+
+    template <typename T, typename... Args>
+    T *share(Expr *&Node, Args &&... args) {
+        if (!Node) {
+            Node = create<T>(std::forward<Args>(args)...);
+            if (Sharing && NumShared < Expr::NoID)
+                Node->setID(NumShared++);
+        }
+        return llvm::cast<T>(Node);
+    }
+
+    Expr *getOperation(AST::ASTKind Kind, tok::TokenKind Op, Expr *LHS, Expr *RHS) {
+        Expr *Unshared = nullptr;
+        Expr *&Node = Sharing ? Operations[{Kind << 16 | Op, LHS, RHS}] : Unshared;
+        if (Kind == AST::AK_UnaryOp)
+            return share<UnaryOp>(Node, Op, LHS);
+        return share<BinaryOp>(Node, LHS, Op, RHS);
+    }
+
+    Literal *getLiteral(uint64_t Value) {
+        Expr *Unshared = nullptr;
+        return share<Literal>(Sharing ? Literals[Value] : Unshared, Value);
+    }
+
+    Variable *getVariable(calc::SymbolTable::SymbolID ID) {
+        Expr *Unshared = nullptr;
+        if (!Sharing)
+            return share<Variable>(Unshared, ID);
+        if (ID >= Variables.size())
+            Variables.resize(ID + 1, nullptr);
+        return share<Variable>(Variables[ID], ID);
+    }
+
+    // Uses of the variable after this see a new value
+    void assigned(calc::SymbolTable::SymbolID ID) {
+        if (ID < Variables.size())
+            Variables[ID] = nullptr;
+    }
 
     calc::DiagnosticsEngine &getDiagnostics() const {
         return Lex.getDiagnostics();
     }
 
+    // Interned ID of the current token, or 0 if it is not an identifier.
+    // Only statements without errors reach the backends, so the 0 of a
+    // misplaced token is never looked at.
+    calc::SymbolTable::SymbolID getSymbol() const {
+        return Tok.is(tok::IDENTIFIER) ? Tok.getSymbol() : 0;
+    }
+
     void panic() {
         expect(tok::SEMI);
         while (!match(tok::SEMI) && !atEnd())
@@ -54,26 +146,31 @@ class Parser {
         return false;
     }
 
-    tok::TokenKind peek() {
-        return Lex.peek();
+    // Kind of the token N places after the current one.
+    tok::TokenKind peek(unsigned N = 1) {
+        return Lex.peek(N - 1).getKind();
     }
 
-    std::unique_ptr<AST> parsecalc();
+    // An operator parseExpr has seen but not applied yet. Binary operators
+    // have a precedence and their left operand, while a `(` or a `-` in
+    // front of an operand have a precedence of 0.
+    struct PendingOp {
+        tok::TokenKind Kind;
+        unsigned Precedence;
+        Expr *LHS;
+    };
 
     // EXPRs
-    std::unique_ptr<Expr> parseExpression();
-    std::unique_ptr<Expr> parseAssign();
-    std::unique_ptr<Expr> parseExpr();
-    std::unique_ptr<Expr> parseTermExpr();
-    std::unique_ptr<Expr> parseUnary();
-    std::unique_ptr<Expr> parseGrouping();
-    std::unique_ptr<Expr> parseBaseExpr();
+    Expr *parseExpression();
+    Expr *parseAssign();
+    Expr *parseExpr();
+    Expr *parseBaseExpr();
     
     // STMTs
-    std::unique_ptr<Stmt> parseStmt();
-    std::unique_ptr<Stmt> parseExprStmt();
-    std::unique_ptr<Stmt> parseDeclare();
-    std::unique_ptr<Stmt> parseRead();
+    Stmt *parseStmt();
+    Stmt *parseExprStmt();
+    Stmt *parseDeclare();
+    Stmt *parseRead();
 
     void unmatchedCharError(Token tok) {
         std::string ch = tok::formatTokenKind(tok.getKind());
@@ -96,7 +193,26 @@ class Parser {
 
     bool hasError() { return HasError; }
 
-    std::unique_ptr<AST> parse();
+    calc::SymbolTable &getSymbols() const {
+        return Lex.getSymbols();
+    }
+
+    // Returns the next statement without errors, or nullptr at the end of
+    // the input. Statements with errors are reported and skipped.
+    AST *parse();
+
+    // Whether the statement parse() returned last may share expressions
+    // with the statements before it. If not, a backend can forget the
+    // nodes it flattened for those.
+    bool sharesWithEarlier() const { return SharesWithEarlier; }
+
+    // Sharing is off unless a backend turns it on. It pays off in the LLVM
+    // backend, where every shared expression is instructions it does not
+    // emit. The interpreter and the VM would only pay for the lookups.
+    void setSharing(bool Enable) {
+        Sharing = Enable;
+        forgetShared();
+    }
 };
 
 #endif
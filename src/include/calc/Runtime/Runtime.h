@@ -0,0 +1,76 @@
+#ifndef CALC_RUNTIME_RUNTIME_H
+#define CALC_RUNTIME_RUNTIME_H
+
+/* Support functions called by compiled calc programs. The library is plain
+ * C so it links into generated executables without a C++ runtime. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Appends the decimal value and a newline to the output buffer. */
+void calc_print(int64_t Value);
+
+/* Appends Size bytes of text that was printed ahead of time by the
+ * compiler. */
+void calc_write(const char *Data, size_t Size);
+
+/* Writes out everything printed so far. */
+void calc_flush(void);
+
+/* Reads the next integer of the input into Slot. Like scanf("%d"), Slot is
+ * left alone when the input is exhausted or holds no integer. */
+void calc_read(int64_t *Slot);
+
+/* Batch programs keep one column of Stride values per read statement and
+ * per printed value. Value Row of column C is Columns[C * Stride + Row]. */
+
+/* Fills the columns with up to Stride records of NumColumns values each and
+ * returns the number of complete records read. A record the input ends in
+ * the middle of is dropped. */
+size_t calc_read_columns(int64_t *Columns, uint32_t NumColumns, size_t Stride);
+
+/* Prints the first Count records of the columns, one record after the
+ * other, exactly as calc_print would. */
+void calc_print_columns(const int64_t *Columns, uint32_t NumColumns, size_t Stride,
+                        size_t Count);
+
+/* Programs compiled with --bigint keep every value in an int64_t that is
+ * either small or big. A small value has its low bit clear and holds the
+ * number shifted left by one, so it is anything from -2^62 to 2^62 - 1.
+ * Adding or subtracting two small values gives the small value of the
+ * result unless the instruction overflows, so the generated code only
+ * calls these functions when it does, or when a value is big. A big value
+ * points to a number of any size, with the low bit set. The functions
+ * below take values of either kind, and return a small value whenever
+ * the result fits in one. */
+
+int64_t calc_big_add(int64_t LHS, int64_t RHS);
+int64_t calc_big_sub(int64_t LHS, int64_t RHS);
+int64_t calc_big_mul(int64_t LHS, int64_t RHS);
+int64_t calc_big_neg(int64_t Value);
+
+/* The value of an ordinary integer, for literals outside the small range */
+int64_t calc_big_from_int(int64_t Value);
+/* The value of a literal too large for 64 bits, from its decimal digits */
+int64_t calc_big_from_digits(const char *Digits, size_t Length);
+
+/* Like calc_print and calc_read. Reading accepts any number of digits. */
+void calc_print_big(int64_t Value);
+void calc_read_big(int64_t *Slot);
+
+/* Reads the input from the file at Path from now on instead of standard
+ * input. Returns 0, or -1 with errno set if the file cannot be opened. */
+int calc_set_input(const char *Path);
+
+/* Called first by every compiled main. Handles --input=path. */
+void calc_init(int Argc, char **Argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef CALC_SERVER_SERVER_H
+#define CALC_SERVER_SERVER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace calc {
+
+// Handles one request, as if the compiler had been called with Args in
+// the client's working directory. Returns the exit status for the client.
+using RequestHandler = llvm::function_ref<int(llvm::ArrayRef<const char *> Args)>;
+
+// Listens on the Unix domain socket at SocketPath and hands every request
+// to Handle, in a process forked from the server for that request alone.
+// Its standard streams are the client's. Only returns on an error.
+int runServer(const char *Argv0, llvm::StringRef SocketPath, RequestHandler Handle);
+
+// Sends Args, our working directory and our standard streams to the
+// server at SocketPath and waits for it to finish. Returns the exit
+// status of the request.
+int runClient(const char *Argv0, llvm::StringRef SocketPath,
+        llvm::ArrayRef<const char *> Args);
+
+} // Namespace calc
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CALC_UTILS_COMPILECACHE_H
+#define CALC_UTILS_COMPILECACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CachePruning.h"
+#include <atomic>
+#include <string>
+
+namespace calc {
+
+// A directory of compiled outputs, each named after a hash of everything
+// that went into it. The same source compiled the same way always gets
+// the same key, so a later compile can reuse the file instead of
+// producing it again. Entries use the llvmcache- prefix that
+// llvm::pruneCache expects.
+class CompileCache {
+    std::string Dir;
+    std::atomic<unsigned> Hits{0};
+    std::atomic<unsigned> Misses{0};
+
+    std::string getEntryPath(llvm::StringRef Key) const;
+
+public:
+    explicit CompileCache(llvm::StringRef Dir) : Dir(Dir.str()) {}
+
+    // Creates the directory if needed. Returns false if it is unusable.
+    bool init(std::string &Error);
+
+    // Hashes the parts into a key. Each part is hashed with its length,
+    // so moving bytes from one part to the next changes the key.
+    static std::string computeKey(llvm::ArrayRef<llvm::StringRef> Parts);
+
+    // Puts the cached output for Key at Path, as a hard link if possible
+    // and as a copy otherwise. Returns false on a miss.
+    bool fetch(llvm::StringRef Key, llvm::StringRef Path);
+    // Adds a copy of the file at Path under Key
+    void store(llvm::StringRef Key, llvm::StringRef Path);
+
+    // Evicts entries until the cache fits the policy
+    void prune(const llvm::CachePruningPolicy &Policy);
+
+    unsigned getHits() const { return Hits; }
+    unsigned getMisses() const { return Misses; }
+};
+
+} // Namespace calc
+
+#endif
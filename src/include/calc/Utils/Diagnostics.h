@@ -24,6 +24,7 @@ class DiagnosticsEngine {
     static llvm::SourceMgr::DiagKind getDiagnosticKind(unsigned DiagID);
 
     llvm::SourceMgr &SrcMgr;
+    llvm::raw_ostream &OS;
     unsigned NumErrors;
 
     template <typename T>
@@ -52,8 +53,8 @@ class DiagnosticsEngine {
     }
 
     public:
-    DiagnosticsEngine(llvm::SourceMgr &SrcMgr) 
-        : SrcMgr(SrcMgr), NumErrors(0) {}
+    DiagnosticsEngine(llvm::SourceMgr &SrcMgr, llvm::raw_ostream &OS = llvm::errs())
+        : SrcMgr(SrcMgr), OS(OS), NumErrors(0) {}
 
     unsigned numErrors() { return NumErrors; }
 
@@ -64,7 +65,7 @@ class DiagnosticsEngine {
                           std::forward<Args>(Arguments)...);
 
         llvm::SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-        SrcMgr.PrintMessage(Loc, Kind, Msg);
+        SrcMgr.PrintMessage(OS, Loc, Kind, Msg);
         NumErrors += (Kind == llvm::SourceMgr::DK_Error);
     }
 };
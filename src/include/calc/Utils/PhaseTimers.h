@@ -0,0 +1,48 @@
+#ifndef CALC_UTILS_PHASETIMERS_H
+#define CALC_UTILS_PHASETIMERS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+namespace calc {
+
+// Measures how long each phase of compiling one input file takes. Every
+// file gets timers of its own, so files compiled in parallel never share
+// one.
+class PhaseTimers {
+public:
+    enum Phase { Parse, IRGen, Verify, Optimize, Emit, Link, Cache, NumPhases };
+
+private:
+    std::string File;
+    // Declared before the timers, so it outlives them
+    llvm::TimerGroup Group;
+    llvm::Timer Timers[NumPhases];
+
+public:
+    explicit PhaseTimers(llvm::StringRef File);
+
+    // For an llvm::TimeRegion around the work of the phase
+    llvm::Timer &get(Phase P) { return Timers[P]; }
+
+    // User and system time are measured for the whole process, so they
+    // only belong to this file if no other file was compiled at the same
+    // time. Without CPUTimes, print and writeJSON leave them out.
+
+    // Prints a table of the phases that ran, like LLVM's -time-passes
+    void print(llvm::raw_ostream &OS, bool CPUTimes = true);
+    // Writes an object with the file name and the wall, user and system
+    // seconds of every phase that ran
+    void writeJSON(llvm::json::OStream &J, bool CPUTimes = true) const;
+
+    // Forgets all times. A group with times left prints them when it is
+    // destroyed.
+    void clear() { Group.clear(); }
+};
+
+} // Namespace calc
+
+#endif
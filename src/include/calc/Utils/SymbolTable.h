@@ -0,0 +1,36 @@
+#ifndef CALC_UTILS_SYMBOLTABLE_H
+#define CALC_UTILS_SYMBOLTABLE_H
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <vector>
+
+namespace calc {
+
+// Interns identifiers. The lexer hands every identifier to the table once
+// and every later stage refers to it by its dense ID, so variables can be
+// kept in plain vectors instead of maps keyed by name.
+class SymbolTable {
+public:
+    using SymbolID = uint32_t;
+
+private:
+    llvm::StringMap<SymbolID> IDs;
+    std::vector<llvm::StringRef> Names;
+    llvm::BitVector Declared;
+
+public:
+    SymbolID intern(llvm::StringRef Name);
+
+    size_t size() const { return Names.size(); }
+    llvm::StringRef getName(SymbolID ID) const { return Names[ID]; }
+
+    bool isDeclared(SymbolID ID) const { return Declared.test(ID); }
+    void declare(SymbolID ID) { Declared.set(ID); }
+};
+
+} // Namespace calc
+
+#endif
@@ -5,6 +5,7 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
 #include <cstddef>
+#include <cstdint>
 
 using namespace calc;
 
@@ -14,6 +15,12 @@ class Token {
     const char *Ptr;
     size_t Length;
     tok::TokenKind Kind;
+    union {
+        // Interned ID of an identifier
+        uint32_t Symbol;
+        // Value of an integer literal, decoded by the lexer
+        uint64_t Value;
+    };
 
 public:
     tok::TokenKind getKind() const { return Kind; }
@@ -29,9 +36,21 @@ public:
         return llvm::StringRef(Ptr, Length);
     }
 
+    uint32_t getSymbol() const {
+        assert(is(tok::IDENTIFIER) &&
+                "Cannot get symbol of non-identifier");
+        return Symbol;
+    }
+
+    uint64_t getValue() const {
+        assert(is(tok::INTEGER_LITERAL) &&
+                "Cannot get value of non-literal");
+        return Value;
+    }
+
     llvm::StringRef getLiteralData() {
         if (is(tok::UNKNOWN)) return llvm::StringRef("Unknown Character");
-        assert(is(tok::INTEGER_LITERAL) &&
+        assert(isOneOf(tok::INTEGER_LITERAL, tok::BIG_INTEGER_LITERAL) &&
             "Cannot get literal data of non-literal");
         return llvm::StringRef(Ptr, Length);
     }
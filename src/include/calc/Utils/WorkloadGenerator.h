@@ -0,0 +1,62 @@
+#ifndef CALC_UTILS_WORKLOADGENERATOR_H
+#define CALC_UTILS_WORKLOADGENERATOR_H
+
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <string>
+
+namespace calc {
+
+// Writes random programs of any size that follow src/Grammar/grammar.txt,
+// for finding out how the compiler scales. The same options and seed
+// always give the same program.
+//
+// Every variable is defined once, in order, before the statements that
+// use them start. The first LeadingReads of them are read from the input
+// and the others are computed from the ones before, so no value is known
+// while compiling and the partial evaluator cannot fold the program away.
+class WorkloadGenerator {
+public:
+    struct Options {
+        // All statements, including the ones that define the variables
+        uint64_t Statements = 1000;
+        uint64_t Variables = 100;
+        // Operators between the root of an expression and its deepest leaf
+        unsigned Depth = 3;
+        unsigned LeadingReads = 8;
+        // Shares of the statements after the definitions. The remainder
+        // are assignments.
+        unsigned ReadPercent = 5;
+        unsigned PrintPercent = 30;
+        // Share of the assignments that use += or -=
+        unsigned CompoundPercent = 30;
+        uint64_t Seed = 1;
+    };
+
+private:
+    Options Opts;
+    uint64_t State;
+    uint64_t NumReads = 0;
+
+    uint64_t pick(uint64_t Bound);
+    void writeLeaf(llvm::raw_ostream &OS, uint64_t Defined);
+    void writeExpr(llvm::raw_ostream &OS, unsigned Depth, uint64_t Defined);
+
+public:
+    explicit WorkloadGenerator(const Options &Opts) : Opts(Opts), State(Opts.Seed) {}
+
+    // Returns false with Error set if the options contradict each other
+    static bool validate(const Options &Opts, std::string &Error);
+
+    void writeProgram(llvm::raw_ostream &OS);
+    // The number of read statements in the program written last
+    uint64_t getNumReads() const { return NumReads; }
+
+    // Writes Records lines of input, each with a value for every read
+    // statement of the program written last
+    void writeInput(llvm::raw_ostream &OS, uint64_t Records);
+};
+
+} // Namespace calc
+
+#endif
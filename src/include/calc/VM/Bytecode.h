@@ -0,0 +1,51 @@
+#ifndef CALC_VM_BYTECODE_H
+#define CALC_VM_BYTECODE_H
+
+#include <calc/Parser/AST.h>
+#include <calc/Parser/Parser.h>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace calc {
+    namespace bc {
+        enum Opcode : uint8_t {
+            #define OPCODE(ID, NAME) ID,
+            #include "Opcodes.def"
+            NUM_OPCODES
+        };
+
+        const char *getOpcodeName(Opcode Op);
+    } // Namespace bc
+} // Namespace calc
+
+// Every instruction has the same size so the VM can step through them
+// with a plain pointer increment. Unused operands are zero.
+struct Instruction {
+    calc::bc::Opcode Op;
+    uint32_t A;
+    uint32_t B;
+    uint32_t C;
+};
+
+struct BytecodeProgram {
+    std::vector<Instruction> Code;
+    // Variable names, indexed by their register
+    std::vector<std::string> Variables;
+    unsigned NumRegisters = 0;
+
+    void dump(llvm::raw_ostream &OS) const;
+};
+
+// Lowers the ASTs of the parser into register bytecode
+class BytecodeGen {
+    Parser& parser;
+
+public:
+    BytecodeGen(Parser &parser) : parser(parser) { }
+    void compile(BytecodeProgram &Program);
+};
+
+#endif
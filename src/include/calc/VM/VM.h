@@ -0,0 +1,21 @@
+#ifndef CALC_VM_VM_H
+#define CALC_VM_VM_H
+
+#include <calc/VM/Bytecode.h>
+#include <cstdint>
+#include <vector>
+
+// Executes register bytecode. Where the compiler supports it, dispatch
+// jumps straight from one instruction's handler to the next through a
+// table of label addresses instead of returning to a central switch.
+class VM {
+    const BytecodeProgram &Program;
+    std::vector<int64_t> Registers;
+
+public:
+    VM(const BytecodeProgram &Program)
+        : Program(Program), Registers(Program.NumRegisters, 0) { }
+    void run();
+};
+
+#endif
@@ -1,42 +1,251 @@
 #include <calc/Generator/CodeGen.h>
-#include "llvm/ADT/StringMap.h"
+#include <calc/Generator/PartialEvaluator.h>
+#include <calc/Parser/FlatAST.h>
+#include "llvm/ADT/BitVector.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include <algorithm>
 
 using namespace llvm;
 
 namespace {
-class IRVisitor : public ASTVisitor {
+// Walks the flattened ASTs front to back. Children come before their
+// parents, so the value of every operand is ready when it is needed.
+// Values the partial evaluator knows become constants, and only the code
+// that depends on input is emitted.
+class IRVisitor {
     Module* M;
+    const calc::SymbolTable &Symbols;
     IRBuilder<> Builder;
     Type* VoidTy;
+    // Every value of the language is an i64. The rest of the i32s are
+    // what main and the runtime take.
+    Type* IntTy;
     Type* Int32Ty;
+    Type* SizeTy;
     PointerType *PtrTy;
+    Constant* IntZero;
     Constant* Int32Zero;
-    Value* PrintStr;
-    Value* ReadStr;
-    Value* V;
-    StringMap<AllocaInst*> nameMap;
+    // Value of each flat node, and the storage of each symbol
+    std::vector<Value*> Values;
+    std::vector<Value*> Slots;
+    // Set when variables are globals shared with other modules. It marks
+    // the variables some module already defined.
+    BitVector *Globals;
+    PartialEvaluator Eval;
+    // Set while the program is the body of the batch loop. Reads load the
+    // current row of the next input column, and prints store to the next
+    // output column.
+    PHINode* BatchRow = nullptr;
+    Value* BatchIn;
+    Value* BatchOut;
+    Value* BatchStride;
+    unsigned NumReads = 0;
+    unsigned NumPrints = 0;
+    // Values are the tagged values of the runtime's calc_big functions.
+    // A constant is always a small one, so its value is the constant
+    // shifted right by one.
+    bool Bigint;
 
-    FunctionType* PrintFTy;
-    FunctionCallee PrintF;
-    FunctionType* ScanFTy;
-    FunctionCallee ScanF;
+    // Input and output go through the runtime library
+    FunctionCallee Init;
+    FunctionCallee Print;
+    FunctionCallee Write;
+    FunctionCallee Flush;
+    FunctionCallee Read;
+    FunctionCallee ReadColumns;
+    FunctionCallee PrintColumns;
+    FunctionCallee BigAdd;
+    FunctionCallee BigSub;
+    FunctionCallee BigMul;
+    FunctionCallee BigFromInt;
+    FunctionCallee BigFromDigits;
+
+    Value* getSlot(calc::SymbolTable::SymbolID ID) {
+        Value*& slot = Slots[ID];
+        if (slot)
+            return slot;
+        if (Globals)
+            slot = getGlobal(ID);
+        else {
+            // In the entry block, where mem2reg expects them, even when
+            // the program is the body of a loop
+            BasicBlock& Entry = Builder.GetInsertBlock()->getParent()->getEntryBlock();
+            IRBuilder<> EntryBuilder(&Entry, Entry.begin());
+            slot = EntryBuilder.CreateAlloca(IntTy, nullptr, Symbols.getName(ID));
+        }
+        return slot;
+    }
+
+    // The first module to use a variable defines it, later ones only
+    // declare it and let the JIT link them together.
+    GlobalVariable* getGlobal(calc::SymbolTable::SymbolID ID) {
+        bool Define = !Globals->test(ID);
+        Globals->set(ID);
+        return new GlobalVariable(*M, IntTy, false, GlobalValue::ExternalLinkage,
+                Define ? IntZero : nullptr, "calc." + Symbols.getName(ID));
+    }
+
+    // With Bigint, a value outside the small range is only made at run time
+    Value* getConstant(int64_t Value) {
+        if (!Bigint)
+            return ConstantInt::get(IntTy, Value, true);
+        if (Value >= -(INT64_C(1) << 62) && Value < (INT64_C(1) << 62))
+            return ConstantInt::get(IntTy, static_cast<uint64_t>(Value) << 1);
+        return Builder.CreateCall(BigFromInt, {ConstantInt::get(IntTy, Value, true)});
+    }
+
+    // Whether V is a constant, and which value it stands for
+    bool isKnown(Value* V, int64_t &Known) {
+        auto* C = dyn_cast<ConstantInt>(V);
+        if (!C)
+            return false;
+        Known = Bigint ? C->getSExtValue() >> 1 : C->getSExtValue();
+        return true;
+    }
+
+    // Folds an operation on two known values. With Bigint, a result that
+    // does not fit in 64 bits is left to the generated code.
+    bool fold(calc::tok::TokenKind Op, Value* LHS, Value* RHS, Value*& Result) {
+        int64_t L, R, Folded;
+        if (!isKnown(LHS, L) || !isKnown(RHS, R))
+            return false;
+        if (!Bigint)
+            Folded = PartialEvaluator::fold(Op, L, R);
+        else if (!PartialEvaluator::foldExact(Op, L, R, Folded))
+            return false;
+        Result = getConstant(Folded);
+        return true;
+    }
+
+    // The value of a variable, or its constant if the evaluator knows it
+    Value* getVariable(calc::SymbolTable::SymbolID ID) {
+        if (Eval.isKnown(ID))
+            return getConstant(Eval.getValue(ID));
+        return Builder.CreateLoad(IntTy, getSlot(ID), Symbols.getName(ID));
+    }
+
+    // Address of the current row in a batch column
+    Value* getColumn(Value* Columns, unsigned Column) {
+        Value* Start = Builder.CreateMul(BatchStride, ConstantInt::get(SizeTy, Column));
+        return Builder.CreateInBoundsGEP(IntTy, Columns,
+                Builder.CreateAdd(Start, BatchRow));
+    }
+
+    // Wrapping arithmetic, or with Bigint the exact arithmetic of tagged
+    // values. Small values are added, subtracted and multiplied inline,
+    // and only an overflow or a big operand calls the runtime.
+    Value* emitArith(calc::tok::TokenKind Op, Value* LHS, Value* RHS) {
+        bool Add = Op == tok::TokenKind::PLUS || Op == tok::TokenKind::PLUSEQUAL;
+        bool Sub = Op == tok::TokenKind::MINUS || Op == tok::TokenKind::MINUSEQUAL;
+        if (!Bigint) {
+            if (Add)
+                return Builder.CreateAdd(LHS, RHS);
+            if (Sub)
+                return Builder.CreateSub(LHS, RHS);
+            return Builder.CreateMul(LHS, RHS);
+        }
+
+        Function* Fn = Builder.GetInsertBlock()->getParent();
+        LLVMContext& Ctx = M->getContext();
+        BasicBlock* Fast = BasicBlock::Create(Ctx, "small", Fn);
+        BasicBlock* Slow = BasicBlock::Create(Ctx, "big", Fn);
+        BasicBlock* Join = BasicBlock::Create(Ctx, "join", Fn);
+        MDBuilder Weights(Ctx);
+
+        Value* Tags = Builder.CreateAnd(Builder.CreateOr(LHS, RHS), 1);
+        Builder.CreateCondBr(Builder.CreateICmpEQ(Tags, IntZero), Fast, Slow,
+                Weights.createBranchWeights(2000, 1));
+
+        // The tags of a sum are the sum of the tags, and one operand of a
+        // product must lose its tag first
+        Builder.SetInsertPoint(Fast);
+        Intrinsic::ID ID = Add ? Intrinsic::sadd_with_overflow
+                : Sub ? Intrinsic::ssub_with_overflow : Intrinsic::smul_with_overflow;
+        Value* Left = Add || Sub ? LHS : Builder.CreateAShr(LHS, 1);
+        Value* Checked = Builder.CreateBinaryIntrinsic(ID, Left, RHS);
+        Value* Small = Builder.CreateExtractValue(Checked, 0);
+        Builder.CreateCondBr(Builder.CreateExtractValue(Checked, 1), Slow, Join,
+                Weights.createBranchWeights(1, 2000));
+        BasicBlock* FastEnd = Builder.GetInsertBlock();
+
+        Builder.SetInsertPoint(Slow);
+        Value* Big = Builder.CreateCall(Add ? BigAdd : Sub ? BigSub : BigMul, {LHS, RHS});
+        Builder.CreateBr(Join);
+
+        Builder.SetInsertPoint(Join);
+        PHINode* Result = Builder.CreatePHI(IntTy, 2);
+        Result->addIncoming(Small, FastEnd);
+        Result->addIncoming(Big, Slow);
+        return Result;
+    }
+
+    void emitPrint(Value* V) {
+        int64_t Known;
+        if (BatchRow) {
+            Builder.CreateStore(V, getColumn(BatchOut, NumPrints++));
+        } else if (isKnown(V, Known)) {
+            Eval.print(Known);
+        } else {
+            emitOutput();
+            Builder.CreateCall(Print, {V});
+        }
+    }
+
+    // Writes what known statements printed so far with a single call,
+    // ahead of anything the program prints at run time
+    void emitOutput() {
+        const std::string &Text = Eval.getOutput();
+        if (Text.empty())
+            return;
+        Constant* Data = ConstantDataArray::getString(M->getContext(), Text, false);
+        auto* GV = new GlobalVariable(*M, Data->getType(), true,
+                GlobalValue::PrivateLinkage, Data, "calc.output");
+        GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        Builder.CreateCall(Write, {GV, ConstantInt::get(SizeTy, Text.size())});
+        Eval.clearOutput();
+    }
+
+    void enterFunction(Function* Fn) {
+        BasicBlock* BB = BasicBlock::Create(M->getContext(), "entry", Fn);
+        Builder.SetInsertPoint(BB);
+    }
 
 public:
-    IRVisitor(Module* M) : M(M), Builder(M->getContext()) {
+    IRVisitor(Module* M, const calc::SymbolTable &Symbols, bool Bigint,
+            BitVector *Globals = nullptr)
+        : M(M), Symbols(Symbols), Builder(M->getContext()), Globals(Globals),
+          Bigint(Bigint) {
         VoidTy = Type::getVoidTy(M->getContext());
+        IntTy = Type::getInt64Ty(M->getContext());
         Int32Ty = Type::getInt32Ty(M->getContext());
+        SizeTy = M->getDataLayout().getIntPtrType(M->getContext());
         PtrTy = PointerType::getUnqual(M->getContext());
+        IntZero = ConstantInt::get(IntTy, 0, true);
         Int32Zero = ConstantInt::get(Int32Ty, 0, true);
 
-        PrintFTy = FunctionType::get(Builder.getInt32Ty(), Builder.getInt8PtrTy(), true);
-        PrintF = M->getOrInsertFunction("printf", PrintFTy);
-        ScanFTy = FunctionType::get(Builder.getInt32Ty(), Builder.getInt8PtrTy(), true);
-        ScanF = M->getOrInsertFunction("scanf", ScanFTy);
+        Print = M->getOrInsertFunction(Bigint ? "calc_print_big" : "calc_print",
+                VoidTy, IntTy);
+        Write = M->getOrInsertFunction("calc_write", VoidTy, PtrTy, SizeTy);
+        Flush = M->getOrInsertFunction("calc_flush", VoidTy);
+        Read = M->getOrInsertFunction(Bigint ? "calc_read_big" : "calc_read",
+                VoidTy, PtrTy);
+        Init = M->getOrInsertFunction("calc_init", VoidTy, Int32Ty, PtrTy);
+        ReadColumns = M->getOrInsertFunction("calc_read_columns",
+                SizeTy, PtrTy, Int32Ty, SizeTy);
+        PrintColumns = M->getOrInsertFunction("calc_print_columns",
+                VoidTy, PtrTy, Int32Ty, SizeTy, SizeTy);
+        BigAdd = M->getOrInsertFunction("calc_big_add", IntTy, IntTy, IntTy);
+        BigSub = M->getOrInsertFunction("calc_big_sub", IntTy, IntTy, IntTy);
+        BigMul = M->getOrInsertFunction("calc_big_mul", IntTy, IntTy, IntTy);
+        BigFromInt = M->getOrInsertFunction("calc_big_from_int", IntTy, IntTy);
+        BigFromDigits = M->getOrInsertFunction("calc_big_from_digits",
+                IntTy, PtrTy, SizeTy);
     }
 
     void createMain() {
@@ -44,108 +253,280 @@ public:
                 Int32Ty, {Int32Ty, PtrTy}, false);
         Function* MainFn = Function::Create(
                 MainFty, GlobalValue::ExternalLinkage, "main", M);
-        BasicBlock* BB = BasicBlock::Create(
-                M->getContext(), "entry", MainFn);
-        Builder.SetInsertPoint(BB);
-        PrintStr = Builder.CreateGlobalStringPtr("%d\n", "pfmt", 0, M);
-        ReadStr = Builder.CreateGlobalStringPtr("%d", "rfmt", 0, M);
+        enterFunction(MainFn);
+        // Lets the runtime see options such as --input=path
+        Builder.CreateCall(Init, {MainFn->getArg(0), MainFn->getArg(1)});
     }
 
     void finishMain() {
+        emitOutput();
+        Builder.CreateCall(Flush);
         Builder.CreateRet(Int32Zero);
     }
 
-    void run(std::unique_ptr<AST> Tree) {
-        Tree->accept(*this);
-        Builder.CreateCall(PrintF, {PrintStr, V});
+    // A void function without arguments, for code that is not a whole program
+    void createFunction(StringRef Name) {
+        Function* Fn = Function::Create(
+                FunctionType::get(VoidTy, false),
+                GlobalValue::ExternalLinkage, Name, M);
+        enterFunction(Fn);
     }
 
-    // We need an accept method for each one in the abstract class
-    // Expression ASTs
-    virtual void visit(Expr &expr) override {
-        //expr.print();
-    };
-    virtual void visit(BinaryOp &expr) override {
-        //expr.print();
-        expr.getLeft()->accept(*this);
-        Value* left = V;
-        expr.getRight()->accept(*this);
-        Value* right = V;
-        if (expr.getOp().is(tok::TokenKind::PLUS))
-            V = Builder.CreateAdd(left, right);
-        else if (expr.getOp().is(tok::TokenKind::MINUS))
-            V = Builder.CreateSub(left, right);
-        else if (expr.getOp().is(tok::TokenKind::STAR))
-            V = Builder.CreateMul(left, right);
-    };
-    virtual void visit(UnaryOp &expr) override {
-        //expr.print();
-        expr.getExpr()->accept(*this);
-        Value* e = V;
-        V = Builder.CreateNSWNeg(e);
-    };
-    virtual void visit(Grouping &expr) override {
-        //expr.print();
-        expr.getExpr()->accept(*this);
-    };
-    virtual void visit(Literal &expr) override {
-        //expr.print();
-        int intval;
-        expr.getData().getAsInteger(10, intval);
-        V = ConstantInt::get(Int32Ty, intval, true);
-    };
-    virtual void visit(Variable &expr) override {
-        //expr.print();
-        AllocaInst* id = nameMap[expr.getData()];
-        V = Builder.CreateLoad(Int32Ty, id, expr.getData());
-    };
-    virtual void visit(Assign &expr) override {
-        //expr.print();
-        auto id = expr.getIdentifier().getIdentifier();
-        AllocaInst* alloca = nameMap[id];
-        if (!alloca) {
-            alloca = Builder.CreateAlloca(Int32Ty, nullptr, id);
-            nameMap[id] = alloca;
-        }
-        expr.getExpr()->accept(*this);
-        if (expr.getOp().is(tok::TokenKind::PLUSEQUAL)) {
-            Value* cur = Builder.CreateLoad(Int32Ty, alloca);
-            V = Builder.CreateNSWAdd(cur, V);
-        } else if (expr.getOp().is(tok::TokenKind::MINUSEQUAL)) {
-            Value* cur = Builder.CreateLoad(Int32Ty, alloca);
-            V = Builder.CreateNSWSub(cur, V);
+    void finishFunction() {
+        emitOutput();
+        Builder.CreateRetVoid();
+    }
+
+    // The loop that runs the program once for each of the first N records
+    // of the In columns, and stores what it prints to the Out columns.
+    // Both column arrays have Stride rows.
+    Function* createBatchKernel() {
+        Function* Fn = Function::Create(
+                FunctionType::get(VoidTy, {PtrTy, PtrTy, SizeTy, SizeTy}, false),
+                GlobalValue::InternalLinkage, "calc.batch", M);
+        // The columns never overlap, which lets the vectorizer work on
+        // several records at once
+        Fn->addParamAttr(0, Attribute::NoAlias);
+        Fn->addParamAttr(1, Attribute::NoAlias);
+        BatchIn = Fn->getArg(0);
+        BatchOut = Fn->getArg(1);
+        BatchStride = Fn->getArg(2);
+        Value* N = Fn->getArg(3);
+
+        enterFunction(Fn);
+        BasicBlock* Loop = BasicBlock::Create(M->getContext(), "loop", Fn);
+        BasicBlock* Exit = BasicBlock::Create(M->getContext(), "exit", Fn);
+        Builder.CreateCondBr(Builder.CreateICmpEQ(N, ConstantInt::get(SizeTy, 0)), Exit, Loop);
+        Builder.SetInsertPoint(Loop);
+        BatchRow = Builder.CreatePHI(SizeTy, 2, "row");
+        BatchRow->addIncoming(ConstantInt::get(SizeTy, 0), &Fn->getEntryBlock());
+        return Fn;
+    }
+
+    void finishBatchKernel() {
+        Function* Fn = Builder.GetInsertBlock()->getParent();
+        Value* Next = Builder.CreateNUWAdd(BatchRow, ConstantInt::get(SizeTy, 1));
+        BatchRow->addIncoming(Next, Builder.GetInsertBlock());
+        Builder.CreateCondBr(Builder.CreateICmpULT(Next, Fn->getArg(3)),
+                BatchRow->getParent(), &Fn->back());
+        Builder.SetInsertPoint(&Fn->back());
+        Builder.CreateRetVoid();
+        BatchRow = nullptr;
+    }
+
+    // Reads a block of records, runs the kernel over them and prints the
+    // results until the input runs out. A program without reads has no
+    // input to wait for and runs once.
+    void createBatchMain(Function* Kernel) {
+        // Enough rows to keep the work of a call large, without making
+        // the columns of a long program huge
+        uint64_t Columns = std::max(NumReads + NumPrints, 1u);
+        uint64_t Rows = std::clamp<uint64_t>((1u << 18) / Columns, 1, 4096);
+        auto createColumns = [&](unsigned Count, StringRef Name) {
+            auto* Ty = ArrayType::get(IntTy, std::max(Count, 1u) * Rows);
+            return new GlobalVariable(*M, Ty, false, GlobalValue::InternalLinkage,
+                    Constant::getNullValue(Ty), Name);
+        };
+        GlobalVariable* In = createColumns(NumReads, "calc.batch.in");
+        GlobalVariable* Out = createColumns(NumPrints, "calc.batch.out");
+        Constant* Stride = ConstantInt::get(SizeTy, Rows);
+        // With a constant stride, the vectorizer can see that the columns
+        // are far enough apart to never overlap
+        Kernel->getArg(2)->replaceAllUsesWith(Stride);
+        Constant* NumIn = ConstantInt::get(Int32Ty, NumReads);
+        Constant* NumOut = ConstantInt::get(Int32Ty, NumPrints);
+
+        createMain();
+        if (NumReads == 0) {
+            Constant* One = ConstantInt::get(SizeTy, 1);
+            Builder.CreateCall(Kernel, {In, Out, Stride, One});
+            Builder.CreateCall(PrintColumns, {Out, NumOut, Stride, One});
+            finishMain();
+            return;
         }
-        Builder.CreateStore(V, alloca);
-    };
 
-    // Statement ASTs
-    virtual void visit(Stmt &stmt) override {
-        //stmt.print();
-    };
-    virtual void visit(Declare &stmt) override {
-        //stmt.print();
-        stmt.getExpr()->accept(*this);
-    };
-    virtual void visit(ExprStmt &stmt) override {
-        //stmt.print();
-        stmt.getExpr()->accept(*this);
-    };
-    virtual void visit(Read &stmt) override {
-        //stmt.print();
-        auto id = stmt.getIdentifier().getIdentifier();
-        AllocaInst* alloca = nameMap[id];
-        if (!alloca) {
-            alloca = Builder.CreateAlloca(Int32Ty, nullptr, id);
-            nameMap[id] = alloca;
+        Function* MainFn = Builder.GetInsertBlock()->getParent();
+        BasicBlock* Loop = BasicBlock::Create(M->getContext(), "loop", MainFn);
+        BasicBlock* Body = BasicBlock::Create(M->getContext(), "body", MainFn);
+        BasicBlock* Done = BasicBlock::Create(M->getContext(), "done", MainFn);
+        Builder.CreateBr(Loop);
+        Builder.SetInsertPoint(Loop);
+        Value* Count = Builder.CreateCall(ReadColumns, {In, NumIn, Stride});
+        Builder.CreateCondBr(Builder.CreateICmpEQ(Count, ConstantInt::get(SizeTy, 0)), Done, Body);
+        Builder.SetInsertPoint(Body);
+        Builder.CreateCall(Kernel, {In, Out, Stride, Count});
+        Builder.CreateCall(PrintColumns, {Out, NumOut, Stride, Count});
+        Builder.CreateBr(Loop);
+        Builder.SetInsertPoint(Done);
+        finishMain();
+    }
+
+    // Every read of the symbol produces Value instead of reading input
+    void bind(calc::SymbolTable::SymbolID ID, int64_t Value) {
+        Eval.bind(ID, Value);
+    }
+
+    // The nodes before Begin were compiled already. Their values are still
+    // valid, and are reused by the shared expressions of later nodes.
+    void run(const FlatAST &Flat, FlatAST::NodeIndex Begin = 0) {
+        Values.resize(Flat.size());
+        Slots.resize(Symbols.size(), nullptr);
+        Eval.resize(Symbols.size());
+        if (Globals)
+            Globals->resize(Symbols.size());
+
+        for (FlatAST::NodeIndex I = Begin; I < Flat.size(); ++I) {
+            Value*& V = Values[I];
+            switch (Flat.getKind(I)) {
+                case AST::AK_BinaryOp: {
+                    Value* left = Values[Flat.getLHS(I)];
+                    Value* right = Values[Flat.getRHS(I)];
+                    if (!fold(Flat.getOp(I), left, right, V))
+                        V = emitArith(Flat.getOp(I), left, right);
+                    break;
+                }
+                case AST::AK_UnaryOp: {
+                    Value* E = Values[Flat.getLHS(I)];
+                    int64_t Known;
+                    if (!Bigint && isKnown(E, Known))
+                        V = getConstant(PartialEvaluator::negate(Known));
+                    else if (!Bigint)
+                        V = Builder.CreateNSWNeg(E);
+                    else if (!fold(tok::TokenKind::MINUS, IntZero, E, V))
+                        V = emitArith(tok::TokenKind::MINUS, IntZero, E);
+                    break;
+                }
+                case AST::AK_Literal:
+                    V = getConstant(static_cast<int64_t>(Flat.getPayload(I)));
+                    break;
+                case AST::AK_BigLiteral: {
+                    // Made from its digits every time it is evaluated, like
+                    // a constant outside the small range
+                    llvm::StringRef Digits = Flat.getDigits(I);
+                    Constant* Data = ConstantDataArray::getString(M->getContext(), Digits, false);
+                    auto* GV = new GlobalVariable(*M, Data->getType(), true,
+                            GlobalValue::PrivateLinkage, Data, "calc.literal");
+                    GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+                    V = Builder.CreateCall(BigFromDigits,
+                            {GV, ConstantInt::get(SizeTy, Digits.size())});
+                    break;
+                }
+                case AST::AK_Variable:
+                    V = getVariable(Flat.getPayload(I));
+                    break;
+                case AST::AK_Assign: {
+                    uint32_t ID = Flat.getPayload(I);
+                    V = Values[Flat.getLHS(I)];
+                    if (Flat.getOp(I) != tok::TokenKind::EQUAL) {
+                        Value* cur = getVariable(ID);
+                        Value* Folded;
+                        if (fold(Flat.getOp(I), cur, V, Folded))
+                            V = Folded;
+                        else if (Bigint)
+                            V = emitArith(Flat.getOp(I), cur, V);
+                        else if (Flat.getOp(I) == tok::TokenKind::PLUSEQUAL)
+                            V = Builder.CreateNSWAdd(cur, V);
+                        else
+                            V = Builder.CreateNSWSub(cur, V);
+                    }
+                    // A known value only lives in the evaluator until
+                    // something needs the variable's storage. Globals are
+                    // seen by later modules, so they are always stored.
+                    int64_t Known;
+                    bool IsKnown = isKnown(V, Known);
+                    if (IsKnown)
+                        Eval.setValue(ID, Known);
+                    else
+                        Eval.forget(ID);
+                    if (!IsKnown || Globals)
+                        Builder.CreateStore(V, getSlot(ID));
+                    break;
+                }
+                case AST::AK_Declare:
+                case AST::AK_ExprStmt:
+                    V = Values[Flat.getLHS(I)];
+                    emitPrint(V);
+                    break;
+                case AST::AK_Read: {
+                    uint32_t ID = Flat.getPayload(I);
+                    if (Eval.isBound(ID)) {
+                        int64_t Bound = Eval.getBinding(ID);
+                        V = getConstant(Bound);
+                        if (isa<ConstantInt>(V))
+                            Eval.setValue(ID, Bound);
+                        else
+                            Eval.forget(ID);
+                        if (Globals || !isa<ConstantInt>(V))
+                            Builder.CreateStore(V, getSlot(ID));
+                        emitPrint(V);
+                        break;
+                    }
+                    if (BatchRow) {
+                        V = Builder.CreateLoad(IntTy, getColumn(BatchIn, NumReads++),
+                                Symbols.getName(ID));
+                        Builder.CreateStore(V, getSlot(ID));
+                        Eval.forget(ID);
+                        emitPrint(V);
+                        break;
+                    }
+                    emitOutput();
+                    Value* slot = getSlot(ID);
+                    // A read that fails leaves the variable as it was, so
+                    // the storage must hold the known value first
+                    if (Eval.isKnown(ID)) {
+                        Builder.CreateStore(getConstant(Eval.getValue(ID)), slot);
+                        Eval.forget(ID);
+                    }
+                    Builder.CreateCall(Read, {slot});
+                    V = Builder.CreateLoad(IntTy, slot, Symbols.getName(ID));
+                    Builder.CreateCall(Print, {V});
+                    break;
+                }
+                default:
+                    break;
+            }
         }
-        Builder.CreateCall(ScanF, {ReadStr, alloca});
-        V = Builder.CreateLoad(Int32Ty, alloca, stmt.getIdentifier().getIdentifier());
-    };
+    }
 };
+
+// Without the C library nothing calls main. The kernel starts the program
+// at _start, with argc and then argv on top of the stack, and the program
+// exits with a system call once main returns.
+const char *getStartCode(const Triple &T) {
+    if (T.getArch() == Triple::aarch64)
+        return R"(
+    .text
+    .globl _start
+    .type _start, %function
+_start:
+    mov x29, #0
+    mov x30, #0
+    ldr x0, [sp]
+    add x1, sp, #8
+    bl main
+    mov x8, #94
+    svc #0
+)";
+    return R"(
+    .text
+    .globl _start
+    .type _start, @function
+_start:
+    xor %ebp, %ebp
+    mov (%rsp), %edi
+    lea 8(%rsp), %rsi
+    and $-16, %rsp
+    call main
+    mov %eax, %edi
+    mov $231, %eax
+    syscall
+)";
+}
 }
 
-void CodeGen::compile(const char* Argv0, const char* F, llvm::TargetMachine* TM) {
-    M = std::make_unique<Module>(F, Ctx);
+void CodeGen::compile(const char* Argv0, const char* F, llvm::TargetMachine* TM,
+        bool Batch, bool Freestanding) {
+    M = std::make_unique<Module>(F, *Ctx);
     M->setTargetTriple(TM->getTargetTriple().str());
     M->setDataLayout(TM->createDataLayout());
     /* A linux executable generally follows PIE
@@ -153,19 +534,62 @@ void CodeGen::compile(const char* Argv0, const char* F, llvm::TargetMachine* TM)
     //M->setPICLevel(llvm::PICLevel::Level::BigPIC);
     //M->setPIELevel(llvm::PIELevel::Level::Large);
 
-    IRVisitor IRV(M.get());
-    IRV.createMain();
-    while (1) {
-        std::unique_ptr<AST> Tree = std::move(parser.parse());
-        if (!Tree) break;
-        IRV.run(std::move(Tree));
+    IRVisitor IRV(M.get(), parser.getSymbols(), Bigint);
+    parser.setSharing(true);
+    for (auto [ID, Value] : Bindings)
+        IRV.bind(ID, Value);
+    llvm::Timer *ParseTimer = Timers ? &Timers->get(calc::PhaseTimers::Parse) : nullptr;
+    llvm::Timer *IRGenTimer = Timers ? &Timers->get(calc::PhaseTimers::IRGen) : nullptr;
+    auto compileProgram = [&] {
+        FlatAST Flat;
+        for (;;) {
+            AST *Tree;
+            {
+                llvm::TimeRegion Region(ParseTimer);
+                Tree = parser.parse();
+            }
+            if (!Tree)
+                break;
+            llvm::TimeRegion Region(IRGenTimer);
+            if (!parser.sharesWithEarlier())
+                Flat.clear();
+            FlatAST::NodeIndex Begin = Flat.size();
+            Flat.append(Tree);
+            IRV.run(Flat, Begin);
+        }
+    };
+    if (Batch) {
+        // The number of input and output columns is only known once the
+        // whole program has been compiled into the loop
+        Function* Kernel = IRV.createBatchKernel();
+        compileProgram();
+        IRV.finishBatchKernel();
+        IRV.createBatchMain(Kernel);
+    } else {
+        IRV.createMain();
+        compileProgram();
+        IRV.finishMain();
     }
-    IRV.finishMain();
+    if (Freestanding)
+        M->appendModuleInlineAsm(getStartCode(TM->getTargetTriple()));
 
     if (!TM) {
         llvm::errs() << "Could not create target machine\n";
         return;
     }
+}
+
+void CodeGen::compileStatement(AST* Tree, llvm::StringRef FnName,
+        const llvm::DataLayout& DL, llvm::BitVector& Globals) {
+    if (!Ctx)
+        Ctx = std::make_unique<LLVMContext>();
+    M = std::make_unique<Module>(FnName, *Ctx);
+    M->setDataLayout(DL);
 
-    M->print(outs(), nullptr);
+    IRVisitor IRV(M.get(), parser.getSymbols(), Bigint, &Globals);
+    IRV.createFunction(FnName);
+    FlatAST Flat;
+    Flat.append(Tree);
+    IRV.run(Flat);
+    IRV.finishFunction();
 }
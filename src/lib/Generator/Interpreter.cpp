@@ -0,0 +1,100 @@
+#include <calc/Generator/Interpreter.h>
+#include <calc/Parser/FlatAST.h>
+#include <calc/Runtime/Runtime.h>
+#include <cstdint>
+#include <vector>
+
+namespace {
+// Values are 64 bit integers that wrap around like the i64 arithmetic
+// emitted by the IRVisitor. The arithmetic is done unsigned to avoid
+// undefined behaviour on overflow.
+int64_t add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+int64_t sub(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+int64_t mul(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
+
+// Walks the flattened ASTs front to back, like the IRVisitor, but computes
+// each node's value instead of emitting instructions for it
+class EvalVisitor {
+    const calc::SymbolTable &Symbols;
+    // Value of each flat node, and the value of each symbol
+    std::vector<int64_t> Values;
+    std::vector<int64_t> Variables;
+
+public:
+    EvalVisitor(const calc::SymbolTable &Symbols) : Symbols(Symbols) { }
+
+    // Uses the same runtime calls as the generated code so the output
+    // matches byte for byte
+    void run(const FlatAST &Flat) {
+        Values.resize(Flat.size());
+        Variables.resize(Symbols.size(), 0);
+
+        for (FlatAST::NodeIndex I = 0; I < Flat.size(); ++I) {
+            int64_t &V = Values[I];
+            switch (Flat.getKind(I)) {
+                case AST::AK_BinaryOp: {
+                    int64_t left = Values[Flat.getLHS(I)];
+                    int64_t right = Values[Flat.getRHS(I)];
+                    if (Flat.getOp(I) == tok::TokenKind::PLUS)
+                        V = add(left, right);
+                    else if (Flat.getOp(I) == tok::TokenKind::MINUS)
+                        V = sub(left, right);
+                    else if (Flat.getOp(I) == tok::TokenKind::STAR)
+                        V = mul(left, right);
+                    break;
+                }
+                case AST::AK_UnaryOp:
+                    V = sub(0, Values[Flat.getLHS(I)]);
+                    break;
+                case AST::AK_Literal:
+                    V = static_cast<int64_t>(Flat.getPayload(I));
+                    break;
+                case AST::AK_Variable:
+                    V = Variables[Flat.getPayload(I)];
+                    break;
+                case AST::AK_Assign: {
+                    int64_t &slot = Variables[Flat.getPayload(I)];
+                    V = Values[Flat.getLHS(I)];
+                    if (Flat.getOp(I) == tok::TokenKind::PLUSEQUAL)
+                        V = add(slot, V);
+                    else if (Flat.getOp(I) == tok::TokenKind::MINUSEQUAL)
+                        V = sub(slot, V);
+                    slot = V;
+                    break;
+                }
+                case AST::AK_Declare:
+                case AST::AK_ExprStmt:
+                    V = Values[Flat.getLHS(I)];
+                    calc_print(V);
+                    break;
+                case AST::AK_Read: {
+                    int64_t &slot = Variables[Flat.getPayload(I)];
+                    calc_read(&slot);
+                    V = slot;
+                    calc_print(V);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+};
+}
+
+void Interpreter::run() {
+    EvalVisitor Eval(parser.getSymbols());
+    FlatAST Flat;
+    while (AST *Tree = parser.parse()) {
+        Flat.clear();
+        Flat.append(Tree);
+        Eval.run(Flat);
+    }
+    calc_flush();
+}
@@ -0,0 +1,60 @@
+#include <calc/Generator/PartialEvaluator.h>
+#include "llvm/Support/MathExtras.h"
+
+void PartialEvaluator::resize(size_t NumSymbols) {
+    Values.resize(NumSymbols, 0);
+    Known.resize(NumSymbols);
+    Bindings.resize(NumSymbols, 0);
+    Bound.resize(NumSymbols);
+}
+
+void PartialEvaluator::bind(SymbolID ID, int64_t Value) {
+    if (ID >= Bound.size())
+        resize(ID + 1);
+    Bindings[ID] = Value;
+    Bound.set(ID);
+}
+
+void PartialEvaluator::print(int64_t Value) {
+    Output += std::to_string(Value);
+    Output += '\n';
+}
+
+// The arithmetic is done unsigned to avoid undefined behaviour on overflow
+int64_t PartialEvaluator::fold(calc::tok::TokenKind Op, int64_t LHS, int64_t RHS) {
+    uint64_t L = static_cast<uint64_t>(LHS);
+    uint64_t R = static_cast<uint64_t>(RHS);
+    switch (Op) {
+        case calc::tok::PLUS:
+        case calc::tok::PLUSEQUAL:
+            return static_cast<int64_t>(L + R);
+        case calc::tok::MINUS:
+        case calc::tok::MINUSEQUAL:
+            return static_cast<int64_t>(L - R);
+        case calc::tok::STAR:
+            return static_cast<int64_t>(L * R);
+        default:
+            return RHS;
+    }
+}
+
+int64_t PartialEvaluator::negate(int64_t Value) {
+    return static_cast<int64_t>(0u - static_cast<uint64_t>(Value));
+}
+
+bool PartialEvaluator::foldExact(calc::tok::TokenKind Op, int64_t LHS, int64_t RHS,
+        int64_t &Result) {
+    switch (Op) {
+        case calc::tok::PLUS:
+        case calc::tok::PLUSEQUAL:
+            return !llvm::AddOverflow(LHS, RHS, Result);
+        case calc::tok::MINUS:
+        case calc::tok::MINUSEQUAL:
+            return !llvm::SubOverflow(LHS, RHS, Result);
+        case calc::tok::STAR:
+            return !llvm::MulOverflow(LHS, RHS, Result);
+        default:
+            Result = RHS;
+            return true;
+    }
+}
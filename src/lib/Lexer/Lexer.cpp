@@ -1,57 +1,279 @@
 #include <calc/Lexer/Lexer.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace charinfo {
-    LLVM_READNONE inline bool isHorizontalWhitespace(char c) {
-        return c == ' ' || c == '\t' || c == '\f' || c == '\v';
-    }
+    enum : unsigned char {
+        CHAR_HORZ_WS = 0x01,
+        CHAR_VERT_WS = 0x02,
+        CHAR_DIGIT   = 0x04,
+        CHAR_LETTER  = 0x08,
+        CHAR_UNDER   = 0x10,
+        CHAR_WS    = CHAR_HORZ_WS | CHAR_VERT_WS,
+        CHAR_IDENT = CHAR_DIGIT | CHAR_LETTER | CHAR_UNDER
+    };
 
-    LLVM_READNONE inline bool isVerticalWhitespace(char c) {
-        return c == '\r' || c == '\n';
+    constexpr std::array<unsigned char, 256> buildInfoTable() {
+        std::array<unsigned char, 256> Table{};
+        for (unsigned char c : {' ', '\t', '\f', '\v'})
+            Table[c] = CHAR_HORZ_WS;
+        for (unsigned char c : {'\r', '\n'})
+            Table[c] = CHAR_VERT_WS;
+        for (unsigned c = '0'; c <= '9'; ++c)
+            Table[c] = CHAR_DIGIT;
+        for (unsigned c = 'a'; c <= 'z'; ++c)
+            Table[c] = Table[c - 'a' + 'A'] = CHAR_LETTER;
+        Table['_'] = CHAR_UNDER;
+        return Table;
     }
 
-    LLVM_READNONE inline bool isWhitespace(char c) {
-        return isHorizontalWhitespace(c) || isVerticalWhitespace(c);
+    constexpr std::array<unsigned char, 256> InfoTable = buildInfoTable();
+
+    LLVM_READNONE inline bool is(char c, unsigned char Class) {
+        return InfoTable[static_cast<unsigned char>(c)] & Class;
     }
 
     LLVM_READNONE inline bool isDigit(char c) {
-        return c >= '0' && c <= '9';
+        return is(c, CHAR_DIGIT);
     }
 
     LLVM_READNONE inline bool isLetter(char c) {
-        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        return is(c, CHAR_LETTER);
+    }
+}
+
+// Skip runs of one character class a vector at a time. Each mask function
+// returns one bit per byte that belongs to the class; the run ends at the
+// first zero bit. Vectors never read past the end of the buffer; the
+// scalar loops need no bound since the buffer ends in a null, which belongs
+// to no class.
+namespace scan {
+#if defined(__AVX2__)
+    struct Vec {
+        using T = __m256i;
+        static constexpr unsigned Width = 32;
+        static T load(const char *P) { return _mm256_loadu_si256(reinterpret_cast<const T *>(P)); }
+        static T splat(char c) { return _mm256_set1_epi8(c); }
+        static T eq(T A, T B) { return _mm256_cmpeq_epi8(A, B); }
+        static T orv(T A, T B) { return _mm256_or_si256(A, B); }
+        static T sub(T A, T B) { return _mm256_sub_epi8(A, B); }
+        static T subSat(T A, T B) { return _mm256_subs_epu8(A, B); }
+        static uint32_t mask(T A) { return static_cast<uint32_t>(_mm256_movemask_epi8(A)); }
+    };
+#elif defined(__SSE2__)
+    struct Vec {
+        using T = __m128i;
+        static constexpr unsigned Width = 16;
+        static T load(const char *P) { return _mm_loadu_si128(reinterpret_cast<const T *>(P)); }
+        static T splat(char c) { return _mm_set1_epi8(c); }
+        static T eq(T A, T B) { return _mm_cmpeq_epi8(A, B); }
+        static T orv(T A, T B) { return _mm_or_si128(A, B); }
+        static T sub(T A, T B) { return _mm_sub_epi8(A, B); }
+        static T subSat(T A, T B) { return _mm_subs_epu8(A, B); }
+        static uint32_t mask(T A) { return static_cast<uint32_t>(_mm_movemask_epi8(A)); }
+    };
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#define CALC_LEXER_SIMD 1
+    // Lo <= c <= Hi, as (c - Lo) saturating-minus (Hi - Lo) == 0.
+    inline Vec::T inRange(Vec::T V, char Lo, char Hi) {
+        return Vec::eq(Vec::subSat(Vec::sub(V, Vec::splat(Lo)), Vec::splat(Hi - Lo)),
+                       Vec::splat(0));
     }
+#endif
+
+    struct Whitespace {
+        static constexpr unsigned char Class = charinfo::CHAR_WS;
+#ifdef CALC_LEXER_SIMD
+        // ' ' and '\t' '\n' '\v' '\f' '\r', which are contiguous.
+        static uint32_t mask(Vec::T V) {
+            return Vec::mask(Vec::orv(Vec::eq(V, Vec::splat(' ')), inRange(V, '\t', '\r')));
+        }
+#endif
+    };
+
+    struct Digits {
+        static constexpr unsigned char Class = charinfo::CHAR_DIGIT;
+#ifdef CALC_LEXER_SIMD
+        static uint32_t mask(Vec::T V) {
+            return Vec::mask(inRange(V, '0', '9'));
+        }
+#endif
+    };
+
+    struct IdentifierBody {
+        static constexpr unsigned char Class = charinfo::CHAR_IDENT;
+#ifdef CALC_LEXER_SIMD
+        // Setting bit 5 folds upper case onto lower case.
+        static uint32_t mask(Vec::T V) {
+            Vec::T Letter = inRange(Vec::orv(V, Vec::splat(0x20)), 'a', 'z');
+            return Vec::mask(Vec::orv(Vec::orv(Letter, inRange(V, '0', '9')),
+                                      Vec::eq(V, Vec::splat('_'))));
+        }
+#endif
+    };
+
+    // Most runs are a byte or two, which a vector load would only slow
+    // down, so the first few bytes are checked with the table.
+    constexpr unsigned ScalarPrefix = 4;
 
-    LLVM_READNONE inline bool isAlphaNumeric(char c) {
-        return isDigit(c) || isLetter(c);
+    template <typename Run>
+    LLVM_ATTRIBUTE_ALWAYS_INLINE const char *skip(const char *Ptr, const char *End) {
+        for (unsigned I = 0; I != ScalarPrefix; ++I, ++Ptr)
+            if (!charinfo::is(*Ptr, Run::Class))
+                return Ptr;
+#ifdef CALC_LEXER_SIMD
+        constexpr uint32_t All = Vec::Width == 32 ? ~0u : (1u << Vec::Width) - 1;
+        while (End - Ptr >= static_cast<ptrdiff_t>(Vec::Width)) {
+            uint32_t M = Run::mask(Vec::load(Ptr));
+            if (M != All)
+                return Ptr + __builtin_ctz(~M);
+            Ptr += Vec::Width;
+        }
+#endif
+        while (charinfo::is(*Ptr, Run::Class))
+            ++Ptr;
+        return Ptr;
     }
 }
 
-void Lexer::next(Token &token) {
-    while (*BufferPtr && charinfo::isWhitespace(*BufferPtr)) {
-        BufferPtr++;
+// Keywords are found with a perfect hash built at compile time from the
+// KEYWORD entries of TokenKinds.def. The hash only looks at the length and
+// the first and last character, and a seed is searched for until every
+// keyword lands in its own slot.
+namespace keywords {
+    struct Keyword {
+        const char *Spelling;
+        unsigned Length;
+        tok::TokenKind Kind;
+    };
+
+    constexpr Keyword List[] = {
+#define KEYWORD(ID, FLAG) { #ID, sizeof(#ID) - 1, tok::kw_ ## ID },
+#include <calc/Utils/TokenKinds.def>
+    };
+
+    constexpr unsigned NumKeywords = sizeof(List) / sizeof(List[0]);
+
+    // Sparse enough that most identifiers land in an empty slot and are
+    // rejected without comparing any characters.
+    constexpr unsigned computeTableSize() {
+        unsigned Size = 64;
+        while (Size < 4 * NumKeywords)
+            Size <<= 1;
+        return Size;
     }
+
+    constexpr unsigned TableSize = computeTableSize();
+
+    constexpr unsigned hash(const char *S, size_t Len, unsigned Seed) {
+        unsigned H = static_cast<unsigned>(Len);
+        H = H * Seed + static_cast<unsigned char>(S[0]);
+        H = H * Seed + static_cast<unsigned char>(S[Len - 1]);
+        return (H ^ (H >> 7)) & (TableSize - 1);
+    }
+
+    constexpr bool isPerfect(unsigned Seed) {
+        bool Used[TableSize] = {};
+        for (const Keyword &K : List) {
+            unsigned H = hash(K.Spelling, K.Length, Seed);
+            if (Used[H])
+                return false;
+            Used[H] = true;
+        }
+        return true;
+    }
+
+    constexpr unsigned findSeed() {
+        for (unsigned Seed = 1; Seed < (1u << 16); ++Seed)
+            if (isPerfect(Seed))
+                return Seed;
+        return 0;
+    }
+
+    // One bit per keyword length, to reject most identifiers before hashing.
+    constexpr uint64_t computeLengths() {
+        uint64_t Lengths = 0;
+        for (const Keyword &K : List)
+            Lengths |= uint64_t(1) << K.Length;
+        return Lengths;
+    }
+
+    constexpr uint64_t Lengths = computeLengths();
+
+    constexpr unsigned Seed = findSeed();
+    static_assert(Seed != 0, "no perfect hash for the keywords, grow the table");
+
+    constexpr std::array<int, TableSize> buildSlots() {
+        std::array<int, TableSize> Slots{};
+        for (int &S : Slots)
+            S = -1;
+        for (unsigned I = 0; I != NumKeywords; ++I)
+            Slots[hash(List[I].Spelling, List[I].Length, Seed)] = I;
+        return Slots;
+    }
+
+    constexpr std::array<int, TableSize> Slots = buildSlots();
+
+    inline tok::TokenKind lookup(llvm::StringRef Name) {
+        if (Name.size() >= 64 || !((Lengths >> Name.size()) & 1))
+            return tok::IDENTIFIER;
+        int Slot = Slots[hash(Name.data(), Name.size(), Seed)];
+        if (Slot < 0)
+            return tok::IDENTIFIER;
+        const Keyword &K = List[Slot];
+        if (Name.size() != K.Length ||
+                std::memcmp(Name.data(), K.Spelling, K.Length) != 0)
+            return tok::IDENTIFIER;
+        return K.Kind;
+    }
+}
+
+// Returns false for a literal that does not fit in an int64_t
+static bool decimalValue(const char *Ptr, const char *End, uint64_t &Value) {
+    Value = 0;
+    for (; Ptr != End; ++Ptr) {
+        unsigned Digit = *Ptr - '0';
+        if (Value > (uint64_t(INT64_MAX) - Digit) / 10)
+            return false;
+        Value = Value * 10 + Digit;
+    }
+    return true;
+}
+
+void Lexer::lex(Token &token) {
+    BufferPtr = scan::skip<scan::Whitespace>(BufferPtr, BufferEnd);
     if (!*BufferPtr) {
         token.Kind = tok::EOI;
         return;
     }
     if (charinfo::isLetter(*BufferPtr)) {
-        const char *end = BufferPtr + 1;
-        while (charinfo::isAlphaNumeric(*end) || *end == '_')
-            end++;
+        const char *end = scan::skip<scan::IdentifierBody>(
+                BufferPtr + 1, BufferEnd);
         llvm::StringRef Name(BufferPtr, end - BufferPtr);
-        if (Name == "read")
-            formToken(token, end, tok::kw_read);
-        else
-            formToken(token, end, tok::IDENTIFIER);
+        tok::TokenKind Kind = keywords::lookup(Name);
+        formToken(token, end, Kind);
+        if (Kind == tok::IDENTIFIER)
+            token.Symbol = Symbols.intern(Name);
         return;
     } else if (charinfo::isDigit(*BufferPtr)) {
-        const char *end = BufferPtr + 1;
-        bool hasRadix = false;
-        while (charinfo::isDigit(*end)) {
-            end++;
-        }
+        const char *end = scan::skip<scan::Digits>(
+                BufferPtr + 1, BufferEnd);
         formToken(token, end, tok::INTEGER_LITERAL);
+        if (!decimalValue(token.Ptr, end, token.Value)) {
+            token.Value = 0;
+            if (Bigint)
+                token.Kind = tok::BIG_INTEGER_LITERAL;
+            else
+                Diag.report(token.getLocation(), diag::err_literal_too_large, token.getLexeme());
+        }
         return;
     } else {
         switch (*BufferPtr) {
@@ -90,14 +312,6 @@ void Lexer::next(Token &token) {
     }
 }
 
-tok::TokenKind Lexer::peek() {
-    const char *buffPtr = BufferPtr;
-    Token tok{};
-    next(tok);
-    BufferPtr = buffPtr;
-    return tok.getKind();
-}
-
 void Lexer::formToken(Token &Tok, const char *TokEnd, tok::TokenKind Kind) {
     Tok.Kind = Kind;
     Tok.Ptr = BufferPtr;
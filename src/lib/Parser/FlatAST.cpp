@@ -0,0 +1,141 @@
+#include <calc/Parser/FlatAST.h>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+
+FlatAST::NodeIndex FlatAST::addNode(AST::ASTKind Kind, tok::TokenKind Op,
+        NodeIndex L, NodeIndex R, uint64_t Data) {
+    Kinds.push_back(Kind);
+    Ops.push_back(Op);
+    LHS.push_back(L);
+    RHS.push_back(R);
+    Payload.push_back(Data);
+    return Kinds.size() - 1;
+}
+
+bool FlatAST::lookup(Expr *E, NodeIndex &I) const {
+    uint16_t ID = E->getID();
+    if (ID == Expr::NoID || ID >= Flattened.size() || Flattened[ID] == NoNode)
+        return false;
+    I = Flattened[ID];
+    return true;
+}
+
+FlatAST::NodeIndex FlatAST::remember(Expr *E, NodeIndex I) {
+    uint16_t ID = E->getID();
+    if (ID != Expr::NoID) {
+        if (ID >= Flattened.size())
+            Flattened.resize(ID + 1, NoNode);
+        Flattened[ID] = I;
+    }
+    return I;
+}
+
+// A post-order walk with explicit stacks, so that even an expression
+// nested a million levels deep needs no C++ frames. An expression is
+// first expanded into its operands, and added once the indices of all of
+// them are on Results.
+FlatAST::NodeIndex FlatAST::flatten(Expr *Root) {
+    struct Step {
+        Expr *E;
+        bool Expanded;
+    };
+    llvm::SmallVector<Step, 32> Work = {{Root, false}};
+    llvm::SmallVector<NodeIndex, 32> Results;
+
+    while (!Work.empty()) {
+        Step S = Work.pop_back_val();
+        Expr *E = S.E;
+        NodeIndex I;
+        if (!S.Expanded && lookup(E, I)) {
+            Results.push_back(I);
+            continue;
+        }
+        switch (E->getKind()) {
+            case AST::AK_BinaryOp: {
+                auto *B = cast<BinaryOp>(E);
+                if (!S.Expanded) {
+                    // The left operand is popped, and so added, first
+                    Work.push_back({E, true});
+                    Work.push_back({B->getRight(), false});
+                    Work.push_back({B->getLeft(), false});
+                    continue;
+                }
+                NodeIndex R = Results.pop_back_val();
+                NodeIndex L = Results.pop_back_val();
+                I = addNode(AST::AK_BinaryOp, B->getOp(), L, R, 0);
+                break;
+            }
+            case AST::AK_UnaryOp: {
+                auto *U = cast<UnaryOp>(E);
+                if (!S.Expanded) {
+                    Work.push_back({E, true});
+                    Work.push_back({U->getExpr(), false});
+                    continue;
+                }
+                I = addNode(AST::AK_UnaryOp, U->getOp(), Results.pop_back_val(), 0, 0);
+                break;
+            }
+            case AST::AK_Grouping:
+                Work.push_back({cast<Grouping>(E)->getExpr(), false});
+                continue;
+            case AST::AK_Literal:
+                I = addNode(AST::AK_Literal, tok::UNKNOWN, 0, 0,
+                        cast<Literal>(E)->getValue());
+                break;
+            case AST::AK_BigLiteral:
+                Digits.push_back(cast<BigLiteral>(E)->getDigits());
+                I = addNode(AST::AK_BigLiteral, tok::UNKNOWN, 0, 0, Digits.size() - 1);
+                break;
+            case AST::AK_Variable:
+                I = addNode(AST::AK_Variable, tok::UNKNOWN, 0, 0,
+                        cast<Variable>(E)->getSymbol());
+                break;
+            case AST::AK_Assign: {
+                auto *A = cast<Assign>(E);
+                if (!S.Expanded) {
+                    Work.push_back({E, true});
+                    Work.push_back({A->getExpr(), false});
+                    continue;
+                }
+                I = addNode(AST::AK_Assign, A->getOp(), Results.pop_back_val(), 0,
+                        A->getSymbol());
+                break;
+            }
+            default:
+                llvm_unreachable("Not an expression");
+        }
+        Results.push_back(remember(E, I));
+    }
+    return Results.back();
+}
+
+FlatAST::NodeIndex FlatAST::append(AST *Tree) {
+    switch (Tree->getKind()) {
+        case AST::AK_Declare: {
+            NodeIndex L = flatten(cast<Declare>(Tree)->getExpr());
+            return addNode(AST::AK_Declare, tok::UNKNOWN, L, 0, 0);
+        }
+        case AST::AK_ExprStmt: {
+            NodeIndex L = flatten(cast<ExprStmt>(Tree)->getExpr());
+            return addNode(AST::AK_ExprStmt, tok::UNKNOWN, L, 0, 0);
+        }
+        case AST::AK_Read:
+            return addNode(AST::AK_Read, tok::UNKNOWN, 0, 0,
+                    cast<Read>(Tree)->getSymbol());
+        default:
+            return flatten(cast<Expr>(Tree));
+    }
+}
+
+void FlatAST::clear() {
+    Kinds.clear();
+    Ops.clear();
+    LHS.clear();
+    RHS.clear();
+    Payload.clear();
+    Digits.clear();
+    Flattened.clear();
+}
@@ -1,21 +1,30 @@
 #include <calc/Parser/Parser.h>
 #include <iostream>
 #include <calc/Utils/TokenKinds.h>
-#include "llvm/ADT/STLExtras.h"
 
 using namespace calc;
 
-std::unique_ptr<AST> Parser::parse() {
-    if (!atEnd())
-        return std::move(parseStmt());
+AST *Parser::parse() {
+    while (!atEnd()) {
+        if (NumShared >= SharingWindow)
+            forgetShared();
+        unsigned NumErrors = getDiagnostics().numErrors();
+        Stmt *stmt = parseStmt();
+        if (getDiagnostics().numErrors() == NumErrors) {
+            SharesWithEarlier = Sharing && !WindowStarted;
+            WindowStarted = false;
+            return stmt;
+        }
+        HasError = true;
+    }
     return nullptr;
 }
 
 // EXPRESSIONS
 
-std::unique_ptr<Expr> Parser::parseExpression() {
+Expr *Parser::parseExpression() {
     tok::TokenKind lookAhead = peek();
-    std::unique_ptr<Expr> expr;
+    Expr *expr;
     if (lookAhead == tok::TokenKind::EQUAL)
         expr = parseAssign();
     else
@@ -23,120 +32,147 @@ std::unique_ptr<Expr> Parser::parseExpression() {
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseAssign() {
-    Token identifier = Tok;
+Expr *Parser::parseAssign() {
+    expect(tok::TokenKind::IDENTIFIER);
+    calc::SymbolTable::SymbolID identifier = getSymbol();
     advance();
     Token op = Tok;
     advance();
-    std::unique_ptr<Expr> expr = parseExpr();
-    return std::make_unique<Assign>(identifier, op, std::move(expr));
+    Expr *expr = parseExpr();
+    assigned(identifier);
+    return create<Assign>(identifier, op.getKind(), expr);
 }
 
 
-std::unique_ptr<Expr> Parser::parseExpr() {
-    std::unique_ptr<Expr> left = parseTermExpr();
-
-    while (Tok.isOneOf(tok::TokenKind::PLUS, tok::TokenKind::MINUS)) {
-        Token tok = Tok;
-        advance();
-        std::unique_ptr<Expr> right = parseExpr();
-        left = std::make_unique<BinaryOp>(std::move(left), tok, std::move(right));
-    }
-
-    return left;
-}
-
-std::unique_ptr<Expr> Parser::parseTermExpr() {
-    std::unique_ptr<Expr> left = parseUnary();
-
-    while (Tok.is(tok::TokenKind::STAR)) {
-        Token tok = Tok;
-        advance();
-        std::unique_ptr<Expr> right = parseTermExpr();
-        left = std::make_unique<BinaryOp>(std::move(left), tok, std::move(right));
-    }
-
-    return left;
-}
-
-std::unique_ptr<Expr> Parser::parseUnary() {
-    if (Tok.is(tok::TokenKind::MINUS)) {
-        Token op = Tok;
-        advance();
-        std::unique_ptr<Expr> expr = parseGrouping();
-        return std::make_unique<UnaryOp>(op, std::move(expr));
-    } else {
-        std::unique_ptr<Expr> expr = parseGrouping();
-        return expr;
+// How tightly a binary operator binds, or 0 if the token is not one
+static unsigned getPrecedence(tok::TokenKind Kind) {
+    switch (Kind) {
+        case tok::TokenKind::PLUS:
+        case tok::TokenKind::MINUS:
+            return 1;
+        case tok::TokenKind::STAR:
+            return 2;
+        default:
+            return 0;
     }
 }
 
-std::unique_ptr<Expr> Parser::parseGrouping() {
-    std::unique_ptr<Expr> expr;
-
-    if (match(tok::TokenKind::L_PAREN)) {
-        advance();
-        if (match(tok::TokenKind::R_PAREN))
+// Operators are right associative, so `a - b + c` is `a - (b + c)` and a
+// `-` in front of an operand only negates that operand. Instead of a C++
+// frame per operator, the operators still waiting for their right operand
+// are kept on a stack, so chains and parentheses can be of any length.
+Expr *Parser::parseExpr() {
+    llvm::SmallVector<PendingOp, 16> Pending;
+    auto isNegation = [&Pending] {
+        return !Pending.empty() && Pending.back().Kind == tok::TokenKind::MINUS
+            && !Pending.back().Precedence;
+    };
+
+    for (;;) {
+        // The start of an operand: a single `-`, or any number of `(`
+        Expr *Operand;
+        if (Tok.is(tok::TokenKind::MINUS) && !isNegation()) {
+            Pending.push_back({tok::TokenKind::MINUS, 0, nullptr});
+            advance();
+            continue;
+        }
+        if (match(tok::TokenKind::L_PAREN)) {
+            advance();
+            if (!match(tok::TokenKind::R_PAREN)) {
+                Pending.push_back({tok::TokenKind::L_PAREN, 0, nullptr});
+                continue;
+            }
             InvalidExprError();
-        else
-            expr = parseExpr();
-        consume(tok::TokenKind::R_PAREN);
-    } else {
-        expr = parseBaseExpr();
-    }
+            advance();
+            Operand = nullptr;
+        } else {
+            Operand = parseBaseExpr();
+        }
 
-    return expr;
+        // Finish everything the operand completes, up to the next operator
+        for (;;) {
+            if (isNegation()) {
+                Operand = getOperation(AST::AK_UnaryOp, tok::TokenKind::MINUS, Operand, nullptr);
+                Pending.pop_back();
+            }
+            // Operators of the same precedence wait for the ones to their
+            // right, which makes them right associative
+            unsigned Precedence = getPrecedence(Tok.getKind());
+            while (!Pending.empty() && Pending.back().Precedence > Precedence) {
+                PendingOp Op = Pending.pop_back_val();
+                Operand = getOperation(AST::AK_BinaryOp, Op.Kind, Op.LHS, Operand);
+            }
+            if (Precedence) {
+                Pending.push_back({Tok.getKind(), Precedence, Operand});
+                advance();
+                break;
+            }
+            if (Pending.empty())
+                return Operand;
+            // Only a `(` can be left, since a `-` is always finished with
+            // the operand right after it
+            consume(tok::TokenKind::R_PAREN);
+            Pending.pop_back();
+        }
+    }
 }
 
-std::unique_ptr<Expr> Parser::parseBaseExpr() {
+Expr *Parser::parseBaseExpr() {
     Token tok = Tok;
     advance();
     if (tok.getKind() == tok::TokenKind::IDENTIFIER) {
-        if (llvm::find(declaredIdentifiers, tok.getIdentifier()) == declaredIdentifiers.end()) {
+        if (!getSymbols().isDeclared(tok.getSymbol())) {
             UndeclaredVariableError(tok);
             return nullptr;
         }
-        return std::make_unique<Variable>(tok);
-    } else if (tok::isLiteral(tok.getKind()))
-        return std::make_unique<Literal>(tok);
+        return getVariable(tok.getSymbol());
+    } else if (tok.is(tok::TokenKind::BIG_INTEGER_LITERAL))
+        return create<BigLiteral>(tok.getLiteralData());
+    else if (tok::isLiteral(tok.getKind()))
+        return getLiteral(tok.getValue());
     InvalidExprError();
     return nullptr;
 }
 
 // STATEMENTS
 
-std::unique_ptr<Stmt> Parser::parseStmt() {
-    if (Tok.is(tok::IDENTIFIER) && (peek() == tok::TokenKind::EQUAL
-                                ||  peek() == tok::TokenKind::PLUSEQUAL
-                                ||  peek() == tok::TokenKind::MINUSEQUAL))
-        return parseDeclare();
+Stmt *Parser::parseStmt() {
+    if (Tok.is(tok::IDENTIFIER)) {
+        tok::TokenKind lookAhead = peek();
+        if (lookAhead == tok::TokenKind::EQUAL
+                || lookAhead == tok::TokenKind::PLUSEQUAL
+                || lookAhead == tok::TokenKind::MINUSEQUAL)
+            return parseDeclare();
+    }
     if (match(tok::TokenKind::kw_read))
         return parseRead();
     return parseExprStmt();
 }
 
-std::unique_ptr<Stmt> Parser::parseDeclare() {
-    if (llvm::find(declaredIdentifiers, Tok.getIdentifier()) == declaredIdentifiers.end())
-        declaredIdentifiers.push_back(Tok.getIdentifier());
-    std::unique_ptr<Expr> expr = parseAssign();
+Stmt *Parser::parseDeclare() {
+    getSymbols().declare(Tok.getSymbol());
+    Expr *expr = parseAssign();
     panic();
     consume(tok::TokenKind::SEMI);
-    return std::make_unique<Declare>(std::move(expr));
+    return create<Declare>(expr);
 }
 
-std::unique_ptr<Stmt> Parser::parseExprStmt() {
-    std::unique_ptr<Stmt> stmt = std::make_unique<ExprStmt>(std::move(parseExpression()));
+Stmt *Parser::parseExprStmt() {
+    Stmt *stmt = create<ExprStmt>(parseExpression());
     panic();
     consume(tok::TokenKind::SEMI);
     return stmt;
 }
 
-std::unique_ptr<Stmt> Parser::parseRead() { 
+Stmt *Parser::parseRead() { 
     consume(tok::TokenKind::kw_read);
-    expect(tok::TokenKind::IDENTIFIER);
-    Token identifier = Tok;
+    // Reading into a variable declares it
+    if (!expect(tok::TokenKind::IDENTIFIER))
+        getSymbols().declare(Tok.getSymbol());
+    calc::SymbolTable::SymbolID identifier = getSymbol();
+    assigned(identifier);
     advance();
     panic();
     consume(tok::TokenKind::SEMI);
-    return std::make_unique<Read>(identifier);
+    return create<Read>(identifier);
 }
@@ -0,0 +1,278 @@
+#include <calc/Runtime/Runtime.h>
+#include "Bignum.h"
+#include "System.h"
+
+/* A big value is a sign and a magnitude of 32 bit limbs, the least
+ * significant first. Its limbs follow it in memory. */
+typedef struct {
+    uint32_t Size;
+    uint32_t Negative;
+} Big;
+
+/* The limbs of any value, big or small */
+typedef struct {
+    const uint32_t *Limbs;
+    uint32_t Size;
+    uint32_t Negative;
+} View;
+
+enum { ArenaSize = 1 << 20 };
+#define MIN_SMALL (-((int64_t)1 << 62))
+#define MAX_SMALL (((int64_t)1 << 62) - 1)
+
+static uint32_t *limbsOf(Big *B) { return (uint32_t *)(B + 1); }
+
+static int isSmall(int64_t Value) { return (Value & 1) == 0; }
+
+/* Programs have no loops, so every value they create is still one of
+ * their variables or results, or was printed already. Nothing is ever
+ * given back, and memory is simply handed out from big blocks. */
+static char *Arena;
+static size_t ArenaLeft;
+
+static void *allocate(size_t Size) {
+    Size = (Size + 7) & ~(size_t)7;
+    if (Size > ArenaLeft) {
+        size_t Block = Size > ArenaSize ? Size : ArenaSize;
+        Arena = (char *)sysAllocate(Block);
+        if (!Arena) {
+            static const char Message[] = "error: out of memory for big integers\n";
+            sysWrite(STDERR_FILENO, Message, sizeof(Message) - 1);
+            sysExit(1);
+        }
+        ArenaLeft = Block;
+    }
+    void *Result = Arena;
+    Arena += Size;
+    ArenaLeft -= Size;
+    return Result;
+}
+
+static Big *allocateBig(uint32_t Size) {
+    Big *B = (Big *)allocate(sizeof(Big) + Size * sizeof(uint32_t));
+    B->Size = Size;
+    B->Negative = 0;
+    return B;
+}
+
+/* Storage holds the limbs of a small value, or of any int64_t */
+static View viewInt(int64_t Value, uint32_t Storage[2]) {
+    uint64_t Magnitude = Value < 0 ? 0u - (uint64_t)Value : (uint64_t)Value;
+    Storage[0] = (uint32_t)Magnitude;
+    Storage[1] = (uint32_t)(Magnitude >> 32);
+    View V = {Storage, Storage[1] ? 2u : Storage[0] ? 1u : 0u, Value < 0};
+    return V;
+}
+
+static View view(int64_t Value, uint32_t Storage[2]) {
+    if (isSmall(Value))
+        return viewInt(Value >> 1, Storage);
+    Big *B = (Big *)(uintptr_t)(Value & ~(int64_t)1);
+    View V = {limbsOf(B), B->Size, B->Negative};
+    return V;
+}
+
+/* Drops leading zero limbs and turns the result back into a small value
+ * if it fits in one */
+static int64_t finish(Big *B) {
+    uint32_t *Limbs = limbsOf(B);
+    while (B->Size && !Limbs[B->Size - 1])
+        --B->Size;
+    if (!B->Size)
+        return 0;
+    if (B->Size <= 2) {
+        uint64_t Magnitude = Limbs[0] | (B->Size == 2 ? (uint64_t)Limbs[1] << 32 : 0);
+        if (B->Negative ? Magnitude <= (uint64_t)1 << 62 : Magnitude <= (uint64_t)MAX_SMALL)
+            return (int64_t)((B->Negative ? 0u - Magnitude : Magnitude) << 1);
+    }
+    return (int64_t)(uintptr_t)B | 1;
+}
+
+static int compareMagnitudes(View A, View B) {
+    if (A.Size != B.Size)
+        return A.Size < B.Size ? -1 : 1;
+    for (uint32_t I = A.Size; I--;)
+        if (A.Limbs[I] != B.Limbs[I])
+            return A.Limbs[I] < B.Limbs[I] ? -1 : 1;
+    return 0;
+}
+
+static int64_t add(View A, View B) {
+    if (A.Negative == B.Negative) {
+        if (A.Size < B.Size) {
+            View T = A;
+            A = B;
+            B = T;
+        }
+        Big *R = allocateBig(A.Size + 1);
+        uint32_t *Limbs = limbsOf(R);
+        uint64_t Carry = 0;
+        for (uint32_t I = 0; I < A.Size; ++I) {
+            Carry += (uint64_t)A.Limbs[I] + (I < B.Size ? B.Limbs[I] : 0);
+            Limbs[I] = (uint32_t)Carry;
+            Carry >>= 32;
+        }
+        Limbs[A.Size] = (uint32_t)Carry;
+        R->Negative = A.Negative;
+        return finish(R);
+    }
+
+    /* The smaller magnitude comes off the larger, which gives the sign */
+    if (compareMagnitudes(A, B) < 0) {
+        View T = A;
+        A = B;
+        B = T;
+    }
+    Big *R = allocateBig(A.Size);
+    uint32_t *Limbs = limbsOf(R);
+    uint64_t Borrow = 0;
+    for (uint32_t I = 0; I < A.Size; ++I) {
+        uint64_t Sub = (uint64_t)(I < B.Size ? B.Limbs[I] : 0) + Borrow;
+        Limbs[I] = (uint32_t)((uint64_t)A.Limbs[I] - Sub);
+        Borrow = A.Limbs[I] < Sub;
+    }
+    R->Negative = A.Negative;
+    return finish(R);
+}
+
+int64_t calc_big_add(int64_t LHS, int64_t RHS) {
+    uint32_t L[2], R[2];
+    return add(view(LHS, L), view(RHS, R));
+}
+
+int64_t calc_big_sub(int64_t LHS, int64_t RHS) {
+    uint32_t L[2], R[2];
+    View V = view(RHS, R);
+    V.Negative = !V.Negative;
+    return add(view(LHS, L), V);
+}
+
+int64_t calc_big_mul(int64_t LHS, int64_t RHS) {
+    uint32_t L[2], R[2];
+    View A = view(LHS, L), B = view(RHS, R);
+    if (!A.Size || !B.Size)
+        return 0;
+    Big *Result = allocateBig(A.Size + B.Size);
+    uint32_t *Limbs = limbsOf(Result);
+    for (uint32_t I = 0; I < Result->Size; ++I)
+        Limbs[I] = 0;
+    for (uint32_t I = 0; I < A.Size; ++I) {
+        uint64_t Carry = 0;
+        for (uint32_t J = 0; J < B.Size; ++J) {
+            Carry += (uint64_t)A.Limbs[I] * B.Limbs[J] + Limbs[I + J];
+            Limbs[I + J] = (uint32_t)Carry;
+            Carry >>= 32;
+        }
+        Limbs[I + B.Size] = (uint32_t)Carry;
+    }
+    Result->Negative = A.Negative != B.Negative;
+    return finish(Result);
+}
+
+int64_t calc_big_neg(int64_t Value) {
+    uint32_t Storage[2];
+    View V = view(Value, Storage);
+    Big *R = allocateBig(V.Size);
+    uint32_t *Limbs = limbsOf(R);
+    for (uint32_t I = 0; I < V.Size; ++I)
+        Limbs[I] = V.Limbs[I];
+    R->Negative = !V.Negative;
+    return finish(R);
+}
+
+int64_t calc_big_from_int(int64_t Value) {
+    if (Value >= MIN_SMALL && Value <= MAX_SMALL)
+        return (int64_t)((uint64_t)Value << 1);
+    uint32_t Storage[2];
+    View V = viewInt(Value, Storage);
+    Big *R = allocateBig(2);
+    limbsOf(R)[0] = Storage[0];
+    limbsOf(R)[1] = Storage[1];
+    R->Negative = V.Negative;
+    return finish(R);
+}
+
+int64_t calc_big_from_digits(const char *Digits, size_t Length) {
+    /* Nine digits at a time, like calc_read_big */
+    int64_t Value = 0;
+    size_t I = 0;
+    while (I < Length) {
+        uint32_t Chunk = 0, Scale = 1;
+        for (; I < Length && Scale < 1000000000; ++I) {
+            Chunk = Chunk * 10 + (uint32_t)(Digits[I] - '0');
+            Scale *= 10;
+        }
+        Value = bigMulAdd(Value, Scale, Chunk);
+    }
+    return Value;
+}
+
+int64_t bigMulAdd(int64_t Value, uint32_t Factor, uint32_t Addend) {
+    if (isSmall(Value)) {
+        int64_t N = Value >> 1;
+        if (N <= (MAX_SMALL - Addend) / Factor)
+            return (N * Factor + Addend) * 2;
+    }
+    uint32_t Storage[2];
+    View V = view(Value, Storage);
+    Big *R = allocateBig(V.Size + 1);
+    uint32_t *Limbs = limbsOf(R);
+    uint64_t Carry = Addend;
+    for (uint32_t I = 0; I < V.Size; ++I) {
+        Carry += (uint64_t)V.Limbs[I] * Factor;
+        Limbs[I] = (uint32_t)Carry;
+        Carry >>= 32;
+    }
+    Limbs[V.Size] = (uint32_t)Carry;
+    return finish(R);
+}
+
+void calc_print_big(int64_t Value) {
+    if (isSmall(Value)) {
+        calc_print(Value >> 1);
+        return;
+    }
+    enum { ChunkDigits = 9, ChunkBase = 1000000000 };
+    uint32_t Storage[2];
+    View V = view(Value, Storage);
+
+    /* Dividing by 10^9 over and over gives nine digits at a time, the last
+     * ones first. A limb never takes more than a chunk and a third. */
+    uint32_t *Quotient = (uint32_t *)allocate(V.Size * sizeof(uint32_t));
+    uint32_t *Chunks = (uint32_t *)allocate((V.Size * 4 / 3 + 1) * sizeof(uint32_t));
+    for (uint32_t I = 0; I < V.Size; ++I)
+        Quotient[I] = V.Limbs[I];
+    uint32_t Size = V.Size, NumChunks = 0;
+    while (Size) {
+        uint64_t Remainder = 0;
+        for (uint32_t I = Size; I--;) {
+            Remainder = Remainder << 32 | Quotient[I];
+            Quotient[I] = (uint32_t)(Remainder / ChunkBase);
+            Remainder %= ChunkBase;
+        }
+        Chunks[NumChunks++] = (uint32_t)Remainder;
+        while (Size && !Quotient[Size - 1])
+            --Size;
+    }
+
+    /* Only the first chunk goes without its leading zeros */
+    char *Text = (char *)allocate(NumChunks * ChunkDigits + 2);
+    char *P = Text;
+    if (V.Negative)
+        *P++ = '-';
+    char First[ChunkDigits];
+    int N = 0;
+    for (uint32_t C = Chunks[NumChunks - 1]; C; C /= 10)
+        First[N++] = (char)('0' + C % 10);
+    while (N)
+        *P++ = First[--N];
+    for (uint32_t I = NumChunks - 1; I--;) {
+        for (int D = ChunkDigits; D--;) {
+            P[D] = (char)('0' + Chunks[I] % 10);
+            Chunks[I] /= 10;
+        }
+        P += ChunkDigits;
+    }
+    *P++ = '\n';
+    calc_write(Text, (size_t)(P - Text));
+}
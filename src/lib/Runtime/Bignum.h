@@ -0,0 +1,13 @@
+#ifndef CALC_RUNTIME_BIGNUM_H
+#define CALC_RUNTIME_BIGNUM_H
+
+/* What the rest of the runtime needs from Bignum.c besides the calc_big
+ * functions of Runtime.h */
+
+#include <stdint.h>
+
+/* Value * Factor + Addend, for a value that is not negative. Reading a
+ * number builds it up this way, a few digits at a time. */
+int64_t bigMulAdd(int64_t Value, uint32_t Factor, uint32_t Addend);
+
+#endif
@@ -0,0 +1,288 @@
+#include <calc/Runtime/Runtime.h>
+#include "Bignum.h"
+#include "System.h"
+
+enum { BufferSize = 1 << 16, MaxLength = 21 /* "-9223372036854775808\n" */ };
+
+static char Buffer[BufferSize];
+static size_t Used;
+/* Like stdio, a terminal gets every line as soon as it is printed.
+ * -1 until the first print finds out. */
+static int LineBuffered = -1;
+
+static const char DigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void writeAll(const char *Data, size_t Size) {
+    size_t Done = 0;
+    while (Done < Size) {
+        long N = sysWrite(STDOUT_FILENO, Data + Done, Size - Done);
+        if (N < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        Done += (size_t)N;
+    }
+}
+
+static int isLineBuffered(void) {
+    if (LineBuffered < 0)
+        LineBuffered = sysIsTerminal(STDOUT_FILENO);
+    return LineBuffered;
+}
+
+void calc_flush(void) {
+    writeAll(Buffer, Used);
+    Used = 0;
+}
+
+void calc_print(int64_t Value) {
+    char Digits[MaxLength];
+    char *End = Digits + MaxLength;
+    char *P = End;
+    uint64_t U = Value < 0 ? 0u - (uint64_t)Value : (uint64_t)Value;
+
+    *--P = '\n';
+    /* Two digits at a time, from the back */
+    while (U >= 100) {
+        unsigned Pair = (U % 100) * 2;
+        U /= 100;
+        P -= 2;
+        memcpy(P, DigitPairs + Pair, 2);
+    }
+    if (U >= 10) {
+        P -= 2;
+        memcpy(P, DigitPairs + U * 2, 2);
+    } else {
+        *--P = (char)('0' + U);
+    }
+    if (Value < 0)
+        *--P = '-';
+
+    if (BufferSize - Used < MaxLength)
+        calc_flush();
+    memcpy(Buffer + Used, P, (size_t)(End - P));
+    Used += (size_t)(End - P);
+
+    if (isLineBuffered())
+        calc_flush();
+}
+
+void calc_write(const char *Data, size_t Size) {
+    if (BufferSize - Used < Size) {
+        calc_flush();
+        /* Too big to be worth copying */
+        if (Size >= BufferSize) {
+            writeAll(Data, Size);
+            return;
+        }
+    }
+    memcpy(Buffer + Used, Data, Size);
+    Used += Size;
+    if (isLineBuffered())
+        calc_flush();
+}
+
+/* Input is either a whole regular file mapped into memory, or a pipe or
+ * terminal read through a buffer. Either way the parser only sees the
+ * bytes from InPtr to InEnd and asks for more when it runs out. */
+static int InFd = STDIN_FILENO;
+static int InReady;
+static const char *InMap;
+static size_t InMapSize;
+static const char *InPtr;
+static const char *InEnd;
+static char InBuffer[BufferSize];
+
+static void releaseInput(void) {
+    if (InMap)
+        sysUnmap(InMap, InMapSize);
+    InMap = NULL;
+    InReady = 0;
+    InPtr = InEnd = NULL;
+}
+
+/* Maps the rest of a regular file, from its current offset on. */
+static void prepareInput(void) {
+    InReady = 1;
+    InPtr = InEnd = InBuffer;
+    long Size = sysFileSize(InFd);
+    if (Size < 0)
+        return;
+    long Offset = sysTell(InFd);
+    if (Offset < 0 || Offset >= Size)
+        return;
+    const void *Map = sysMap(InFd, (size_t)Size);
+    if (!Map)
+        return;
+    InMap = (const char *)Map;
+    InMapSize = (size_t)Size;
+    InPtr = InMap + Offset;
+    InEnd = InMap + InMapSize;
+}
+
+/* Returns 0 once the input is exhausted. */
+static int refill(void) {
+    if (!InReady)
+        prepareInput();
+    if (InPtr != InEnd)
+        return 1;
+    if (InMap)
+        return 0;
+    for (;;) {
+        long N = sysRead(InFd, InBuffer, sizeof(InBuffer));
+        if (N < 0 && errno == EINTR)
+            continue;
+        if (N <= 0)
+            return 0;
+        InPtr = InBuffer;
+        InEnd = InBuffer + N;
+        return 1;
+    }
+}
+
+static int peekInput(void) {
+    if (InPtr == InEnd && !refill())
+        return -1;
+    return (unsigned char)*InPtr;
+}
+
+/* Skips whitespace and the sign of the next integer. Returns 0 if there is
+ * no integer to read, and otherwise its first digit. */
+static int startValue(int *Negative) {
+    int C;
+    /* The whitespace scanf skips: ' ' and '\t' through '\r' */
+    while ((C = peekInput()) == ' ' || (C >= '\t' && C <= '\r'))
+        ++InPtr;
+
+    *Negative = C == '-';
+    if (C == '-' || C == '+') {
+        ++InPtr;
+        C = peekInput();
+    }
+    return C >= '0' && C <= '9' ? C : 0;
+}
+
+/* Returns 0 without touching Slot if there is no integer to read. */
+static int readValue(int64_t *Slot) {
+    int Negative;
+    int C = startValue(&Negative);
+    if (!C)
+        return 0;
+
+    /* Wraps around on overflow, like the arithmetic of the program */
+    uint64_t Value = 0;
+    do {
+        Value = Value * 10 + (uint64_t)(C - '0');
+        ++InPtr;
+    } while ((C = peekInput()) >= '0' && C <= '9');
+    *Slot = (int64_t)(Negative ? 0u - Value : Value);
+    return 1;
+}
+
+void calc_read(int64_t *Slot) {
+    readValue(Slot);
+}
+
+void calc_read_big(int64_t *Slot) {
+    int Negative;
+    int C = startValue(&Negative);
+    if (!C)
+        return;
+
+    /* Nine digits at a time always fit in the factor and the addend */
+    int64_t Value = 0;
+    do {
+        uint32_t Chunk = 0, Scale = 1;
+        do {
+            Chunk = Chunk * 10 + (uint32_t)(C - '0');
+            Scale *= 10;
+            ++InPtr;
+        } while (Scale < 1000000000 && (C = peekInput()) >= '0' && C <= '9');
+        Value = bigMulAdd(Value, Scale, Chunk);
+    } while ((C = peekInput()) >= '0' && C <= '9');
+    *Slot = Negative ? calc_big_neg(Value) : Value;
+}
+
+size_t calc_read_columns(int64_t *Columns, uint32_t NumColumns, size_t Stride) {
+    for (size_t Row = 0; Row < Stride; ++Row)
+        for (uint32_t Column = 0; Column < NumColumns; ++Column)
+            if (!readValue(&Columns[Column * Stride + Row]))
+                return Row;
+    return Stride;
+}
+
+void calc_print_columns(const int64_t *Columns, uint32_t NumColumns, size_t Stride,
+                        size_t Count) {
+    for (size_t Row = 0; Row < Count; ++Row)
+        for (uint32_t Column = 0; Column < NumColumns; ++Column)
+            calc_print(Columns[Column * Stride + Row]);
+}
+
+int calc_set_input(const char *Path) {
+    int Fd = sysOpen(Path);
+    if (Fd < 0)
+        return -1;
+    releaseInput();
+    if (InFd != STDIN_FILENO)
+        sysClose(InFd);
+    InFd = Fd;
+    return 0;
+}
+
+CALC_NO_LIBCALLS static void writeError(const char *Text) {
+    size_t Size = 0;
+    while (Text[Size])
+        ++Size;
+    sysWrite(STDERR_FILENO, Text, Size);
+}
+
+void calc_init(int Argc, char **Argv) {
+    static const char Option[] = "--input=";
+    for (int I = 1; I < Argc; ++I) {
+        size_t N = 0;
+        while (N < sizeof(Option) - 1 && Argv[I][N] == Option[N])
+            ++N;
+        if (N != sizeof(Option) - 1)
+            continue;
+        const char *Path = Argv[I] + N;
+        if (calc_set_input(Path) != 0) {
+            const char *Reason = sysDescribe(errno);
+            writeError("error: cannot read ");
+            writeError(Path);
+            writeError(": ");
+            writeError(Reason);
+            writeError("\n");
+            sysExit(1);
+        }
+    }
+}
+
+#ifdef CALC_FREESTANDING
+/* Compilers call these for copies and zeroing of their own, and there is
+ * no C library to provide them */
+CALC_NO_LIBCALLS void *memcpy(void *Dest, const void *Src, size_t Size) {
+    unsigned char *D = (unsigned char *)Dest;
+    const unsigned char *S = (const unsigned char *)Src;
+    while (Size--)
+        *D++ = *S++;
+    return Dest;
+}
+
+CALC_NO_LIBCALLS void *memset(void *Dest, int Value, size_t Size) {
+    unsigned char *D = (unsigned char *)Dest;
+    while (Size--)
+        *D++ = (unsigned char)Value;
+    return Dest;
+}
+#endif
@@ -0,0 +1,187 @@
+#ifndef CALC_RUNTIME_SYSTEM_H
+#define CALC_RUNTIME_SYSTEM_H
+
+/* The operating system services the runtime needs. A hosted build gets
+ * them from the C library. Built with CALC_FREESTANDING, the runtime makes
+ * the system calls itself, and programs linked with it need no C library
+ * at all. Either way, failures return -1 and set errno. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CALC_FREESTANDING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline long sysRead(int Fd, void *Data, size_t Size) { return read(Fd, Data, Size); }
+static inline long sysWrite(int Fd, const void *Data, size_t Size) {
+    return write(Fd, Data, Size);
+}
+static inline int sysOpen(const char *Path) { return open(Path, O_RDONLY); }
+static inline void sysClose(int Fd) { close(Fd); }
+static inline int sysIsTerminal(int Fd) { return isatty(Fd); }
+static inline long sysTell(int Fd) { return (long)lseek(Fd, 0, SEEK_CUR); }
+
+/* The size of a regular file, or -1 for anything else */
+static inline long sysFileSize(int Fd) {
+    struct stat St;
+    if (fstat(Fd, &St) != 0 || !S_ISREG(St.st_mode))
+        return -1;
+    return (long)St.st_size;
+}
+
+/* Maps Size bytes of the file read-only, or returns NULL */
+static inline const void *sysMap(int Fd, size_t Size) {
+    void *Map = mmap(NULL, Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    return Map == MAP_FAILED ? NULL : Map;
+}
+static inline void sysUnmap(const void *Map, size_t Size) { munmap((void *)Map, Size); }
+
+/* Size bytes of fresh memory that is never given back, or NULL */
+static inline void *sysAllocate(size_t Size) { return malloc(Size); }
+
+static inline const char *sysDescribe(int Error) { return strerror(Error); }
+static inline void sysExit(int Code) { exit(Code); }
+
+#define CALC_NO_LIBCALLS
+
+#else
+
+enum { STDIN_FILENO = 0, STDOUT_FILENO = 1, STDERR_FILENO = 2 };
+enum { EINTR = 4 };
+
+/* Only ever touched by the runtime itself, which is single threaded */
+static int errno;
+
+#if defined(__x86_64__)
+enum {
+    SYS_read = 0, SYS_write = 1, SYS_close = 3, SYS_lseek = 8, SYS_mmap = 9,
+    SYS_munmap = 11, SYS_ioctl = 16, SYS_exit_group = 231, SYS_openat = 257,
+};
+
+static inline long sysCall(long N, long A, long B, long C, long D, long E, long F) {
+    register long R10 __asm__("r10") = D;
+    register long R8 __asm__("r8") = E;
+    register long R9 __asm__("r9") = F;
+    long Ret;
+    __asm__ volatile("syscall"
+                     : "=a"(Ret)
+                     : "a"(N), "D"(A), "S"(B), "d"(C), "r"(R10), "r"(R8), "r"(R9)
+                     : "rcx", "r11", "memory");
+    return Ret;
+}
+#elif defined(__aarch64__)
+enum {
+    SYS_ioctl = 29, SYS_openat = 56, SYS_close = 57, SYS_lseek = 62, SYS_read = 63,
+    SYS_write = 64, SYS_exit_group = 94, SYS_munmap = 215, SYS_mmap = 222,
+};
+
+static inline long sysCall(long N, long A, long B, long C, long D, long E, long F) {
+    register long X8 __asm__("x8") = N;
+    register long X0 __asm__("x0") = A;
+    register long X1 __asm__("x1") = B;
+    register long X2 __asm__("x2") = C;
+    register long X3 __asm__("x3") = D;
+    register long X4 __asm__("x4") = E;
+    register long X5 __asm__("x5") = F;
+    __asm__ volatile("svc 0"
+                     : "+r"(X0)
+                     : "r"(X8), "r"(X1), "r"(X2), "r"(X3), "r"(X4), "r"(X5)
+                     : "memory");
+    return X0;
+}
+#else
+#error "Freestanding programs are only supported on x86_64 and aarch64 Linux"
+#endif
+
+/* The kernel returns -errno on failure */
+static inline long sysResult(long Ret) {
+    if (Ret < 0 && Ret > -4096) {
+        errno = (int)-Ret;
+        return -1;
+    }
+    return Ret;
+}
+
+static inline long sysRead(int Fd, void *Data, size_t Size) {
+    return sysResult(sysCall(SYS_read, Fd, (long)Data, (long)Size, 0, 0, 0));
+}
+static inline long sysWrite(int Fd, const void *Data, size_t Size) {
+    return sysResult(sysCall(SYS_write, Fd, (long)Data, (long)Size, 0, 0, 0));
+}
+static inline int sysOpen(const char *Path) {
+    enum { AT_FDCWD = -100, O_RDONLY = 0 };
+    return (int)sysResult(sysCall(SYS_openat, AT_FDCWD, (long)Path, O_RDONLY, 0, 0, 0));
+}
+static inline void sysClose(int Fd) { sysCall(SYS_close, Fd, 0, 0, 0, 0, 0); }
+
+static inline int sysIsTerminal(int Fd) {
+    enum { TCGETS = 0x5401 };
+    char Termios[64];
+    return sysCall(SYS_ioctl, Fd, TCGETS, (long)Termios, 0, 0, 0) == 0;
+}
+
+static inline long sysTell(int Fd) {
+    enum { SEEK_CUR = 1 };
+    return sysResult(sysCall(SYS_lseek, Fd, 0, SEEK_CUR, 0, 0, 0));
+}
+
+/* Where the end of a file is tells its size without the layout of struct
+ * stat, which differs between architectures. Pipes cannot seek, and
+ * devices report a size of 0, so both end up being read instead. */
+static inline long sysFileSize(int Fd) {
+    enum { SEEK_SET = 0, SEEK_END = 2 };
+    long Offset = sysTell(Fd);
+    if (Offset < 0)
+        return -1;
+    long Size = sysResult(sysCall(SYS_lseek, Fd, 0, SEEK_END, 0, 0, 0));
+    sysCall(SYS_lseek, Fd, Offset, SEEK_SET, 0, 0, 0);
+    return Size;
+}
+
+static inline const void *sysMap(int Fd, size_t Size) {
+    enum { PROT_READ = 1, MAP_PRIVATE = 2 };
+    long Map = sysResult(sysCall(SYS_mmap, 0, (long)Size, PROT_READ, MAP_PRIVATE, Fd, 0));
+    return Map == -1 ? NULL : (const void *)Map;
+}
+static inline void sysUnmap(const void *Map, size_t Size) {
+    sysCall(SYS_munmap, (long)Map, (long)Size, 0, 0, 0, 0);
+}
+
+static inline void *sysAllocate(size_t Size) {
+    enum { PROT_READ_WRITE = 3, MAP_PRIVATE_ANONYMOUS = 0x22 };
+    long Map = sysResult(
+        sysCall(SYS_mmap, 0, (long)Size, PROT_READ_WRITE, MAP_PRIVATE_ANONYMOUS, -1, 0));
+    return Map == -1 ? NULL : (void *)Map;
+}
+
+/* There is no table of messages without the C library */
+static inline const char *sysDescribe(int Error) {
+    (void)Error;
+    return "cannot open file";
+}
+
+static inline void sysExit(int Code) {
+    for (;;)
+        sysCall(SYS_exit_group, Code, 0, 0, 0, 0, 0);
+}
+
+/* Keeps GCC from turning a loop into a call to the C library */
+#if defined(__GNUC__) && !defined(__clang__)
+#define CALC_NO_LIBCALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#else
+#define CALC_NO_LIBCALLS
+#endif
+
+void *memcpy(void *Dest, const void *Src, size_t Size);
+void *memset(void *Dest, int Value, size_t Size);
+
+#endif
+
+#endif
@@ -0,0 +1,268 @@
+#include <calc/Server/Server.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace calc;
+
+namespace {
+// A client lends the server its stdin, stdout and stderr
+constexpr int NumStreams = 3;
+
+std::string lastError() {
+    return std::error_code(errno, std::generic_category()).message();
+}
+
+bool fillAddress(llvm::StringRef Path, sockaddr_un &Addr) {
+    if (Path.size() >= sizeof(Addr.sun_path))
+        return false;
+    std::memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    std::memcpy(Addr.sun_path, Path.data(), Path.size());
+    return true;
+}
+
+bool writeAll(int FD, const void *Data, size_t Size) {
+    const char *Bytes = static_cast<const char *>(Data);
+    while (Size) {
+        ssize_t Written = ::write(FD, Bytes, Size);
+        if (Written < 0 && errno == EINTR)
+            continue;
+        if (Written <= 0)
+            return false;
+        Bytes += Written;
+        Size -= Written;
+    }
+    return true;
+}
+
+bool readAll(int FD, void *Data, size_t Size) {
+    char *Bytes = static_cast<char *>(Data);
+    while (Size) {
+        ssize_t Read = ::read(FD, Bytes, Size);
+        if (Read < 0 && errno == EINTR)
+            continue;
+        if (Read <= 0)
+            return false;
+        Bytes += Read;
+        Size -= Read;
+    }
+    return true;
+}
+
+// The file descriptors travel as SCM_RIGHTS next to the first bytes of
+// a request, and arrive as new descriptors of the same open files
+union StreamsMessage {
+    cmsghdr Header;
+    char Buffer[CMSG_SPACE(sizeof(int) * NumStreams)];
+};
+
+bool sendStreams(int Socket, const void *Data, size_t Size) {
+    iovec IO = {const_cast<void *>(Data), Size};
+    StreamsMessage Control;
+    std::memset(&Control, 0, sizeof(Control));
+    msghdr Msg = {};
+    Msg.msg_iov = &IO;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control.Buffer;
+    Msg.msg_controllen = sizeof(Control.Buffer);
+    cmsghdr *C = CMSG_FIRSTHDR(&Msg);
+    C->cmsg_level = SOL_SOCKET;
+    C->cmsg_type = SCM_RIGHTS;
+    C->cmsg_len = CMSG_LEN(sizeof(int) * NumStreams);
+    const int Streams[NumStreams] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    std::memcpy(CMSG_DATA(C), Streams, sizeof(Streams));
+
+    ssize_t Sent;
+    do
+        Sent = ::sendmsg(Socket, &Msg, 0);
+    while (Sent < 0 && errno == EINTR);
+    if (Sent < 0)
+        return false;
+    return writeAll(Socket, static_cast<const char *>(Data) + Sent, Size - Sent);
+}
+
+bool receiveStreams(int Socket, void *Data, size_t Size, int (&Streams)[NumStreams]) {
+    iovec IO = {Data, Size};
+    StreamsMessage Control;
+    msghdr Msg = {};
+    Msg.msg_iov = &IO;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control.Buffer;
+    Msg.msg_controllen = sizeof(Control.Buffer);
+
+    ssize_t Received;
+    do
+        Received = ::recvmsg(Socket, &Msg, MSG_CMSG_CLOEXEC);
+    while (Received < 0 && errno == EINTR);
+    if (Received <= 0)
+        return false;
+    cmsghdr *C = CMSG_FIRSTHDR(&Msg);
+    if (!C || C->cmsg_level != SOL_SOCKET || C->cmsg_type != SCM_RIGHTS ||
+            C->cmsg_len != CMSG_LEN(sizeof(int) * NumStreams))
+        return false;
+    std::memcpy(Streams, CMSG_DATA(C), sizeof(Streams));
+    return readAll(Socket, static_cast<char *>(Data) + Received, Size - Received);
+}
+
+// Runs one request of the client connected to Client, in the process
+// forked for it
+int serve(int Client, RequestHandler Handle) {
+    uint32_t Size;
+    int Streams[NumStreams];
+    if (!receiveStreams(Client, &Size, sizeof(Size), Streams))
+        return 1;
+
+    // The working directory and the arguments, each ending in a null
+    std::string Request(Size, '\0');
+    bool Complete = readAll(Client, Request.data(), Size);
+    llvm::SmallVector<const char *, 32> Args;
+    for (size_t I = 0; Complete && I < Request.size(); I += std::strlen(&Request[I]) + 1)
+        Args.push_back(&Request[I]);
+
+    for (int FD = 0; FD < NumStreams; ++FD) {
+        ::dup2(Streams[FD], FD);
+        ::close(Streams[FD]);
+    }
+
+    int32_t Status = 1;
+    if (Args.size() < 2 || Request.back() != '\0') {
+        llvm::WithColor::error(llvm::errs()) << "Malformed request to the server\n";
+    } else if (std::error_code EC = llvm::sys::fs::set_current_path(Args[0])) {
+        llvm::WithColor::error(llvm::errs())
+            << "Cannot change to " << Args[0] << ": " << EC.message() << '\n';
+    } else {
+        Status = Handle(llvm::ArrayRef<const char *>(Args).drop_front());
+    }
+
+    // Everything the request printed comes before its status
+    llvm::outs().flush();
+    std::fflush(nullptr);
+    writeAll(Client, &Status, sizeof(Status));
+    return 0;
+}
+}
+
+int calc::runServer(const char *Argv0, llvm::StringRef SocketPath, RequestHandler Handle) {
+    // Every request changes to the client's working directory
+    llvm::SmallString<128> Path(SocketPath);
+    llvm::sys::fs::make_absolute(Path);
+    sockaddr_un Addr;
+    if (!fillAddress(Path, Addr)) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "Socket path is too long: " << Path << '\n';
+        return 1;
+    }
+
+    int Listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (Listener < 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "Cannot create a socket: " << lastError() << '\n';
+        return 1;
+    }
+    int Bound = ::bind(Listener, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr));
+    if (Bound < 0 && errno == EADDRINUSE) {
+        // A socket left behind by a server that is gone is replaced, one
+        // that still answers is not
+        int Probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool Answers = Probe >= 0 &&
+            ::connect(Probe, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) == 0;
+        if (Probe >= 0)
+            ::close(Probe);
+        if (Answers) {
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "A server is already listening on " << Path << '\n';
+            return 1;
+        }
+        ::unlink(Path.c_str());
+        Bound = ::bind(Listener, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr));
+    }
+    if (Bound < 0 || ::listen(Listener, SOMAXCONN) < 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot listen on " << Path << ": " << lastError() << '\n';
+        return 1;
+    }
+    // Requests finish on their own, nobody waits for them
+    ::signal(SIGCHLD, SIG_IGN);
+
+    // Anything still buffered would come out again in every request
+    llvm::outs() << "Listening on " << Path << '\n';
+    llvm::outs().flush();
+    for (;;) {
+        int Client = ::accept4(Listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (Client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "Cannot accept a client: " << lastError() << '\n';
+            return 1;
+        }
+
+        // Every request gets a copy of the server with everything set up
+        // already. Nothing it changes leaks into the next request, a crash
+        // only ends the request, and requests run side by side.
+        pid_t Child = ::fork();
+        if (Child == 0) {
+            ::close(Listener);
+            // The linker the request runs must be waited for
+            ::signal(SIGCHLD, SIG_DFL);
+            int Result = serve(Client, Handle);
+            ::_exit(Result);
+        }
+        if (Child < 0)
+            llvm::WithColor::error(llvm::errs(), Argv0)
+                << "Cannot start a request: " << lastError() << '\n';
+        ::close(Client);
+    }
+}
+int calc::runClient(const char *Argv0, llvm::StringRef SocketPath,
+        llvm::ArrayRef<const char *> Args) {
+    sockaddr_un Addr;
+    if (!fillAddress(SocketPath, Addr)) {
+        llvm::WithColor::error(llvm::errs(), Argv0) << "Socket path is too long: " << SocketPath << '\n';
+        return 1;
+    }
+    int Socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (Socket < 0 || ::connect(Socket, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot connect to the server at " << SocketPath << ": " << lastError() << '\n';
+        return 1;
+    }
+
+    llvm::SmallString<256> CWD;
+    if (std::error_code EC = llvm::sys::fs::current_path(CWD)) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "Cannot find the working directory: " << EC.message() << '\n';
+        return 1;
+    }
+    std::string Request(CWD.str());
+    Request += '\0';
+    for (llvm::StringRef Arg : Args) {
+        Request += Arg;
+        Request += '\0';
+    }
+
+    uint32_t Size = Request.size();
+    int32_t Status;
+    if (!sendStreams(Socket, &Size, sizeof(Size)) ||
+            !writeAll(Socket, Request.data(), Request.size()) ||
+            !readAll(Socket, &Status, sizeof(Status))) {
+        llvm::WithColor::error(llvm::errs(), Argv0)
+            << "The server at " << SocketPath << " did not finish the request\n";
+        ::close(Socket);
+        return 1;
+    }
+    ::close(Socket);
+    return Status;
+}
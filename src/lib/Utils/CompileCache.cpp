@@ -0,0 +1,89 @@
+#include <calc/Utils/CompileCache.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/BLAKE3.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+using namespace calc;
+
+std::string CompileCache::getEntryPath(llvm::StringRef Key) const {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, "llvmcache-" + Key);
+    return std::string(Path);
+}
+
+bool CompileCache::init(std::string &Error) {
+    if (std::error_code EC = llvm::sys::fs::create_directories(Dir)) {
+        Error = EC.message();
+        return false;
+    }
+    return true;
+}
+
+std::string CompileCache::computeKey(llvm::ArrayRef<llvm::StringRef> Parts) {
+    llvm::BLAKE3 Hasher;
+    for (llvm::StringRef Part : Parts) {
+        uint8_t Size[8];
+        llvm::support::endian::write64le(Size, Part.size());
+        Hasher.update(Size);
+        Hasher.update(Part);
+    }
+    return llvm::toHex(Hasher.final(), /*LowerCase=*/true);
+}
+
+bool CompileCache::fetch(llvm::StringRef Key, llvm::StringRef Path) {
+    std::string Entry = getEntryPath(Key);
+    if (!llvm::sys::fs::exists(Entry)) {
+        ++Misses;
+        return false;
+    }
+
+    llvm::sys::fs::remove(Path);
+    if (llvm::sys::fs::create_hard_link(Entry, Path)) {
+        // Different file systems, or no hard links at all
+        if (llvm::sys::fs::copy_file(Entry, Path)) {
+            ++Misses;
+            return false;
+        }
+        if (auto Perms = llvm::sys::fs::getPermissions(Entry))
+            llvm::sys::fs::setPermissions(Path, *Perms);
+    }
+
+    // Pruning evicts the entries that were used least recently first
+    int FD;
+    if (!llvm::sys::fs::openFileForRead(Entry, FD)) {
+        llvm::sys::fs::setLastAccessAndModificationTime(FD, std::chrono::system_clock::now());
+        llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+    }
+    ++Hits;
+    return true;
+}
+
+void CompileCache::store(llvm::StringRef Key, llvm::StringRef Path) {
+    // Concurrent compiles may store the same key. Copying to a file of our
+    // own and renaming it into place means nobody sees half an entry.
+    llvm::SmallString<128> Model(Dir);
+    llvm::sys::path::append(Model, "tmp-%%%%%%%%");
+    llvm::SmallString<128> Tmp;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(Model, FD, Tmp))
+        return;
+    llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+
+    bool Failed = static_cast<bool>(llvm::sys::fs::copy_file(Path, Tmp));
+    if (!Failed) {
+        if (auto Perms = llvm::sys::fs::getPermissions(Path))
+            llvm::sys::fs::setPermissions(Tmp, *Perms);
+        Failed = static_cast<bool>(llvm::sys::fs::rename(Tmp, getEntryPath(Key)));
+    }
+    if (Failed)
+        llvm::sys::fs::remove(Tmp);
+}
+
+void CompileCache::prune(const llvm::CachePruningPolicy &Policy) {
+    llvm::pruneCache(Dir, Policy);
+}
@@ -0,0 +1,91 @@
+#include <calc/Utils/PhaseTimers.h>
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+using namespace calc;
+
+namespace {
+// Name for the JSON report and description for the table of every phase
+const char *const PhaseNames[][2] = {
+    {"parse", "Lexing and parsing"},
+    {"irgen", "IR generation"},
+    {"verify", "Module verification"},
+    {"optimize", "Optimization"},
+    {"emit", "Code emission"},
+    {"link", "Linking"},
+    {"cache", "Compile cache"},
+};
+static_assert(std::size(PhaseNames) == PhaseTimers::NumPhases,
+        "every phase needs a name");
+
+void writeTime(llvm::json::OStream &J, const llvm::TimeRecord &Time, bool CPUTimes) {
+    J.attribute("wall", Time.getWallTime());
+    if (!CPUTimes)
+        return;
+    J.attribute("user", Time.getUserTime());
+    J.attribute("system", Time.getSystemTime());
+}
+}
+
+PhaseTimers::PhaseTimers(llvm::StringRef File)
+    : File(File.str()), Group("calc", "Compiling " + File.str()) {
+    for (unsigned P = 0; P < NumPhases; ++P)
+        Timers[P].init(PhaseNames[P][0], PhaseNames[P][1], Group);
+}
+
+void PhaseTimers::print(llvm::raw_ostream &OS, bool CPUTimes) {
+    if (CPUTimes) {
+        Group.print(OS, /*ResetAfterPrint=*/true);
+        return;
+    }
+
+    // LLVM's table always has the user and system columns, so the one
+    // without them is printed here in the same layout, slowest phase first
+    std::vector<std::pair<double, unsigned>> Walls;
+    double Total = 0;
+    for (unsigned P = 0; P < NumPhases; ++P) {
+        if (!Timers[P].hasTriggered())
+            continue;
+        double Wall = Timers[P].getTotalTime().getWallTime();
+        Walls.emplace_back(Wall, P);
+        Total += Wall;
+    }
+    llvm::sort(Walls, std::greater<>());
+
+    auto printWall = [&](double Wall, llvm::StringRef Name) {
+        OS << llvm::format("  %7.4f (%5.1f%%)", Wall, Total < 1e-7 ? 0 : Wall * 100 / Total)
+            << "  " << Name << '\n';
+    };
+    std::string Title = "Compiling " + File;
+    std::string Rule = "===" + std::string(73, '-') + "===\n";
+    OS << Rule;
+    OS.indent(Title.size() < 80 ? (80 - Title.size()) / 2 : 0) << Title << '\n';
+    OS << Rule;
+    OS << llvm::format("  Total Execution Time: %5.4f seconds wall clock\n\n", Total);
+    OS << "   ---Wall Time---  --- Name ---\n";
+    for (const auto &[Wall, P] : Walls)
+        printWall(Wall, PhaseNames[P][1]);
+    printWall(Total, "Total");
+    OS << '\n';
+}
+
+void PhaseTimers::writeJSON(llvm::json::OStream &J, bool CPUTimes) const {
+    llvm::TimeRecord Total;
+    J.object([&] {
+        J.attribute("file", File);
+        J.attributeObject("phases", [&] {
+            for (unsigned P = 0; P < NumPhases; ++P) {
+                if (!Timers[P].hasTriggered())
+                    continue;
+                llvm::TimeRecord Time = Timers[P].getTotalTime();
+                Total += Time;
+                J.attributeObject(PhaseNames[P][0], [&] { writeTime(J, Time, CPUTimes); });
+            }
+        });
+        J.attributeObject("total", [&] { writeTime(J, Total, CPUTimes); });
+    });
+}
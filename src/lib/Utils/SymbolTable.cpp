@@ -0,0 +1,13 @@
+#include <calc/Utils/SymbolTable.h>
+
+using namespace calc;
+
+SymbolTable::SymbolID SymbolTable::intern(llvm::StringRef Name) {
+    auto Entry = IDs.try_emplace(Name, Names.size());
+    if (Entry.second) {
+        // The key stored in the map stays put, so the name can point to it
+        Names.push_back(Entry.first->getKey());
+        Declared.push_back(false);
+    }
+    return Entry.first->second;
+}
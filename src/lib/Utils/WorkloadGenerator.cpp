@@ -0,0 +1,113 @@
+#include <calc/Utils/WorkloadGenerator.h>
+
+using namespace calc;
+
+uint64_t WorkloadGenerator::pick(uint64_t Bound) {
+    // A 64 bit linear congruential generator. Its high bits are good
+    // enough for picking statements, and it is the same everywhere.
+    State = State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (State >> 16) % Bound;
+}
+
+bool WorkloadGenerator::validate(const Options &Opts, std::string &Error) {
+    if (Opts.Variables == 0)
+        Error = "a program needs at least one variable";
+    else if (Opts.Statements < Opts.Variables)
+        Error = "every variable takes a statement to define, so there must be at least as many statements";
+    else if (Opts.LeadingReads > Opts.Variables)
+        Error = "cannot read more variables than there are";
+    else if (Opts.ReadPercent + Opts.PrintPercent > 100)
+        Error = "reads and prints cannot be more than 100% of the statements";
+    else if (Opts.CompoundPercent > 100)
+        Error = "compound assignments cannot be more than 100% of the assignments";
+    else
+        return true;
+    return false;
+}
+
+// A variable defined before, or a literal if there is none yet. Sometimes
+// negated, which the grammar allows right before any operand.
+void WorkloadGenerator::writeLeaf(llvm::raw_ostream &OS, uint64_t Defined) {
+    if (pick(8) == 0)
+        OS << '-';
+    if (Defined && pick(4) != 0)
+        OS << 'v' << pick(Defined);
+    else
+        OS << pick(1000);
+}
+
+// Grows the expression down one side only, so its size is linear in Depth
+void WorkloadGenerator::writeExpr(llvm::raw_ostream &OS, unsigned Depth, uint64_t Defined) {
+    if (Depth == 0) {
+        writeLeaf(OS, Defined);
+        return;
+    }
+    static const char *const Ops[] = {" + ", " - ", " * "};
+    const char *Op = Ops[pick(3)];
+    bool DeepOnLeft = pick(2) == 0;
+    // Only a grouping can be a sum inside a product, or any binary
+    // operation on the left of one. Elsewhere the parentheses are optional.
+    bool Parens = DeepOnLeft || Op[1] == '*' || pick(4) == 0;
+    auto writeDeep = [&] {
+        if (!Parens) {
+            writeExpr(OS, Depth - 1, Defined);
+            return;
+        }
+        if (pick(8) == 0)
+            OS << '-';
+        OS << '(';
+        writeExpr(OS, Depth - 1, Defined);
+        OS << ')';
+    };
+    if (DeepOnLeft) {
+        writeDeep();
+        OS << Op;
+        writeLeaf(OS, Defined);
+    } else {
+        writeLeaf(OS, Defined);
+        OS << Op;
+        writeDeep();
+    }
+}
+
+void WorkloadGenerator::writeProgram(llvm::raw_ostream &OS) {
+    NumReads = 0;
+    for (uint64_t V = 0; V < Opts.Variables; ++V) {
+        if (V < Opts.LeadingReads) {
+            OS << "read v" << V << ";\n";
+            ++NumReads;
+            continue;
+        }
+        OS << 'v' << V << " = ";
+        writeExpr(OS, Opts.Depth, V);
+        OS << ";\n";
+    }
+
+    for (uint64_t S = Opts.Variables; S < Opts.Statements; ++S) {
+        uint64_t Kind = pick(100);
+        if (Kind < Opts.ReadPercent) {
+            OS << "read v" << pick(Opts.Variables) << ";\n";
+            ++NumReads;
+            continue;
+        }
+        if (Kind < Opts.ReadPercent + Opts.PrintPercent) {
+            writeExpr(OS, Opts.Depth, Opts.Variables);
+            OS << ";\n";
+            continue;
+        }
+        OS << 'v' << pick(Opts.Variables);
+        if (pick(100) < Opts.CompoundPercent)
+            OS << (pick(2) ? " += " : " -= ");
+        else
+            OS << " = ";
+        writeExpr(OS, Opts.Depth, Opts.Variables);
+        OS << ";\n";
+    }
+}
+
+void WorkloadGenerator::writeInput(llvm::raw_ostream &OS, uint64_t Records) {
+    for (uint64_t R = 0; R < Records; ++R)
+        for (uint64_t I = 0; I < NumReads; ++I)
+            OS << static_cast<int64_t>(pick(2000001)) - 1000000
+                << (I + 1 == NumReads ? '\n' : ' ');
+}
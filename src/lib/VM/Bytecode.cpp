@@ -0,0 +1,247 @@
+#include <calc/VM/Bytecode.h>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+
+using namespace llvm;
+using namespace calc;
+
+static const char * const OpcodeNames[] = {
+#define OPCODE(ID, NAME) NAME,
+#include <calc/VM/Opcodes.def>
+    nullptr
+};
+
+const char *bc::getOpcodeName(Opcode Op) {
+    return OpcodeNames[Op];
+}
+
+namespace {
+// Which operands of an instruction name registers. Everything else is
+// either unused or an immediate.
+bool usesA(bc::Opcode Op) { return Op != bc::Halt; }
+bool usesB(bc::Opcode Op) {
+    return Op == bc::Move || Op == bc::Add || Op == bc::Sub
+        || Op == bc::Mul || Op == bc::Neg;
+}
+bool usesC(bc::Opcode Op) {
+    return Op == bc::Add || Op == bc::Sub || Op == bc::Mul;
+}
+
+// The number of variables is only known once the whole program has been
+// lowered, so temporaries are numbered from zero with this flag set and
+// moved behind the variables at the end.
+const uint32_t TempFlag = 1u << 31;
+
+// Every symbol owns the register with the same number
+class LowerVisitor : public ASTVisitor {
+    BytecodeProgram &Program;
+    const SymbolTable &Symbols;
+    // Register holding the value of the last visited AST
+    uint32_t R;
+    // Temporaries are released in stack order once their parent is lowered
+    uint32_t NextTemp;
+    uint32_t MaxTemps;
+
+    uint32_t newTemp() {
+        uint32_t Temp = NextTemp++;
+        MaxTemps = std::max(MaxTemps, NextTemp);
+        return TempFlag | Temp;
+    }
+
+    void emit(bc::Opcode Op, uint32_t A, uint32_t B = 0, uint32_t C = 0) {
+        Program.Code.push_back({Op, A, B, C});
+    }
+
+    bc::Opcode getOpcode(tok::TokenKind Op) {
+        if (Op == tok::TokenKind::PLUS)
+            return bc::Add;
+        if (Op == tok::TokenKind::MINUS)
+            return bc::Sub;
+        return bc::Mul;
+    }
+
+public:
+    LowerVisitor(BytecodeProgram &Program, const SymbolTable &Symbols)
+        : Program(Program), Symbols(Symbols), R(0), NextTemp(0), MaxTemps(0) { }
+
+    void run(AST *Tree) {
+        NextTemp = 0;
+        Tree->accept(*this);
+        emit(bc::Print, R);
+    }
+
+    void finish() {
+        emit(bc::Halt, 0);
+        uint32_t NumVariables = Symbols.size();
+        for (uint32_t ID = 0; ID < NumVariables; ++ID)
+            Program.Variables.push_back(Symbols.getName(ID).str());
+        auto place = [NumVariables](uint32_t &Reg) {
+            if (Reg & TempFlag)
+                Reg = NumVariables + (Reg & ~TempFlag);
+        };
+        for (Instruction &I : Program.Code) {
+            if (usesA(I.Op)) place(I.A);
+            if (usesB(I.Op)) place(I.B);
+            if (usesC(I.Op)) place(I.C);
+        }
+        Program.NumRegisters = NumVariables + MaxTemps;
+    }
+
+    // Lowers an expression into R. The operators whose operands are still
+    // being lowered wait on a stack instead of in C++ frames, so a chain
+    // like a + b + c + ... can be of any length.
+    void lower(Expr *Root) {
+        struct Step {
+            Expr *E;
+            // Where the temporaries stood before E was started
+            uint32_t Mark;
+            // The register of the left operand once it is lowered
+            uint32_t Left;
+            bool LeftDone;
+        };
+        llvm::SmallVector<Step, 32> Work;
+        Expr *E = Root;
+        for (;;) {
+            // Go down the left operands until one has none of its own
+            while (E) {
+                switch (E->getKind()) {
+                    case AST::AK_BinaryOp:
+                        Work.push_back({E, NextTemp, 0, false});
+                        E = cast<BinaryOp>(E)->getLeft();
+                        break;
+                    case AST::AK_UnaryOp:
+                        Work.push_back({E, NextTemp, 0, false});
+                        E = cast<UnaryOp>(E)->getExpr();
+                        break;
+                    case AST::AK_Grouping:
+                        E = cast<Grouping>(E)->getExpr();
+                        break;
+                    case AST::AK_Assign:
+                        Work.push_back({E, NextTemp, 0, false});
+                        E = cast<Assign>(E)->getExpr();
+                        break;
+                    case AST::AK_Literal: {
+                        R = newTemp();
+                        uint64_t Value = cast<Literal>(E)->getValue();
+                        emit(bc::LoadImm, R, static_cast<uint32_t>(Value),
+                                static_cast<uint32_t>(Value >> 32));
+                        E = nullptr;
+                        break;
+                    }
+                    case AST::AK_Variable:
+                        R = cast<Variable>(E)->getSymbol();
+                        E = nullptr;
+                        break;
+                    default:
+                        llvm_unreachable("Not an expression");
+                }
+            }
+
+            // R holds the operand that was just finished. Finish the
+            // expressions waiting for it, up to one that still needs its
+            // right operand.
+            while (!E) {
+                if (Work.empty())
+                    return;
+                Step &S = Work.back();
+                if (auto *B = dyn_cast<BinaryOp>(S.E)) {
+                    if (!S.LeftDone) {
+                        S.Left = R;
+                        S.LeftDone = true;
+                        E = B->getRight();
+                        continue;
+                    }
+                    uint32_t Right = R;
+                    NextTemp = S.Mark;
+                    R = newTemp();
+                    emit(getOpcode(B->getOp()), R, S.Left, Right);
+                } else if (isa<UnaryOp>(S.E)) {
+                    uint32_t Value = R;
+                    NextTemp = S.Mark;
+                    R = newTemp();
+                    emit(bc::Neg, R, Value);
+                } else {
+                    lowerAssign(*cast<Assign>(S.E));
+                }
+                Work.pop_back();
+            }
+        }
+    }
+
+    void lowerAssign(Assign &expr) {
+        uint32_t Var = expr.getSymbol();
+        if (expr.getOp() == tok::TokenKind::PLUSEQUAL)
+            emit(bc::Add, Var, Var, R);
+        else if (expr.getOp() == tok::TokenKind::MINUSEQUAL)
+            emit(bc::Sub, Var, Var, R);
+        else if ((R & TempFlag) && Program.Code.back().A == R)
+            // The value was just computed into a temporary, so compute it
+            // straight into the variable instead
+            Program.Code.back().A = Var;
+        else
+            emit(bc::Move, Var, R);
+        R = Var;
+    }
+
+    // Expression ASTs
+    virtual void visit(Expr &expr) override { };
+    virtual void visit(BinaryOp &expr) override { lower(&expr); };
+    virtual void visit(UnaryOp &expr) override { lower(&expr); };
+    virtual void visit(Grouping &expr) override { lower(&expr); };
+    virtual void visit(Literal &expr) override { lower(&expr); };
+    virtual void visit(BigLiteral &expr) override {
+        llvm_unreachable("Only programs compiled with LLVM take --bigint");
+    };
+    virtual void visit(Variable &expr) override { lower(&expr); };
+    virtual void visit(Assign &expr) override { lower(&expr); };
+
+    // Statement ASTs
+    virtual void visit(Stmt &stmt) override { };
+    virtual void visit(Declare &stmt) override {
+        stmt.getExpr()->accept(*this);
+    };
+    virtual void visit(ExprStmt &stmt) override {
+        stmt.getExpr()->accept(*this);
+    };
+    virtual void visit(Read &stmt) override {
+        R = stmt.getSymbol();
+        emit(bc::Read, R);
+    };
+};
+}
+
+void BytecodeGen::compile(BytecodeProgram &Program) {
+    LowerVisitor Lower(Program, parser.getSymbols());
+    while (AST *Tree = parser.parse())
+        Lower.run(Tree);
+    Lower.finish();
+}
+
+void BytecodeProgram::dump(raw_ostream &OS) const {
+    OS << "; " << Variables.size() << " variables, "
+       << NumRegisters << " registers\n";
+    for (unsigned i = 0; i < Variables.size(); ++i)
+        OS << ";   r" << i << " = " << Variables[i] << '\n';
+
+    for (unsigned i = 0; i < Code.size(); ++i) {
+        const Instruction &I = Code[i];
+        OS << format("%5u  ", i);
+        if (I.Op == bc::Halt) {
+            OS << bc::getOpcodeName(I.Op) << '\n';
+            continue;
+        }
+        OS << format("%-8s", bc::getOpcodeName(I.Op));
+        if (I.Op == bc::LoadImm)
+            OS << " r" << I.A << ", "
+               << static_cast<int64_t>(static_cast<uint64_t>(I.C) << 32 | I.B);
+        else {
+            if (usesA(I.Op)) OS << " r" << I.A;
+            if (usesB(I.Op)) OS << ", r" << I.B;
+            if (usesC(I.Op)) OS << ", r" << I.C;
+        }
+        OS << '\n';
+    }
+}
@@ -0,0 +1,81 @@
+#include <calc/VM/VM.h>
+#include <calc/Runtime/Runtime.h>
+
+using namespace calc;
+
+// Computed goto is a GNU extension, other compilers fall back to a switch
+#if defined(__GNUC__)
+#define CALC_VM_COMPUTED_GOTO 1
+#else
+#define CALC_VM_COMPUTED_GOTO 0
+#endif
+
+namespace {
+// Registers wrap around like the i64 arithmetic of the compiled program
+int64_t add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+int64_t sub(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+int64_t mul(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
+}
+
+void VM::run() {
+    int64_t *R = Registers.data();
+    const Instruction *IP = Program.Code.data();
+
+#if CALC_VM_COMPUTED_GOTO
+    static void *const Handlers[] = {
+        #define OPCODE(ID, NAME) &&op_##ID,
+        #include <calc/VM/Opcodes.def>
+    };
+    #define CASE(ID) op_##ID:
+    #define NEXT() goto *Handlers[(++IP)->Op]
+    goto *Handlers[IP->Op];
+#else
+    #define CASE(ID) case bc::ID:
+    #define NEXT() continue
+    for (;; ++IP)
+    switch (IP->Op) {
+#endif
+
+    CASE(LoadImm)
+        R[IP->A] = static_cast<int64_t>(static_cast<uint64_t>(IP->C) << 32 | IP->B);
+        NEXT();
+    CASE(Move)
+        R[IP->A] = R[IP->B];
+        NEXT();
+    CASE(Add)
+        R[IP->A] = add(R[IP->B], R[IP->C]);
+        NEXT();
+    CASE(Sub)
+        R[IP->A] = sub(R[IP->B], R[IP->C]);
+        NEXT();
+    CASE(Mul)
+        R[IP->A] = mul(R[IP->B], R[IP->C]);
+        NEXT();
+    CASE(Neg)
+        R[IP->A] = sub(0, R[IP->B]);
+        NEXT();
+    CASE(Read)
+        // Same runtime calls as the compiled program so the output matches
+        calc_read(&R[IP->A]);
+        NEXT();
+    CASE(Print)
+        calc_print(R[IP->A]);
+        NEXT();
+    CASE(Halt)
+        calc_flush();
+        return;
+
+#if !CALC_VM_COMPUTED_GOTO
+    default:
+        return;
+    }
+#endif
+    #undef CASE
+    #undef NEXT
+}